@@ -5,8 +5,14 @@ BIN:=$(BUILD)/bin/$(NAME)
 O_DIR:=$(BUILD)/cache
 
 PLUGINS=
+# multiple monitor support (one bar per output, see '--outputs'), 'make RANDR=1'.
+RANDR=
+# USDT probes (see 'lib/clubar/probes.h'), 'make USDT=1'.
+USDT=
 FLAGS:=-Wall -Wextra -Wvla -pedantic -Ofast -ggdb
 DEFINE:=-D_GNU_SOURCE                       \
         -DNAME='"$(NAME)"'                  \
         -DVERSION='"$(VERSION)"'            \
-        $(PLUGINS:%=-D__ENABLE_PLUGIN__%__)
+        $(PLUGINS:%=-D__ENABLE_PLUGIN__%__) \
+        $(if $(RANDR),-D__ENABLE_RANDR__)   \
+        $(if $(USDT),-D__ENABLE_USDT__)
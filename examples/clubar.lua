@@ -23,4 +23,28 @@ Config = {
     foreground = "#efefef",
     background = "#090909",
     fonts = {"monospace-9", "monospace-9:bold"},
+    -- native status modules, format: 'name[:interval[:format]]'.
+    modules = {
+        "cpu:2:<Fg=#8f8> CPU </Fg>%s",
+        "memory:5:<Fg=#88f> MEM </Fg>%s",
+        "clock:1:<Fn=1> %H:%M </Fn>",
+    },
+    -- producer plugins ('*.so', see 'clubar/plugin.h'), loaded at startup.
+    plugins = os.getenv("HOME") .. "/.config/clubar/plugins",
+    -- '<Style=name> ... </Style>' expands to these tags (parsed once).
+    styles = {
+        warn = "<Fg=#f55><Box:Bottom=#f55:2>",
+        ok = "<Fg=#8f8>",
+    },
 };
+
+-- in-process producers (no fork/pipe), called every 'interval' seconds, the
+-- returned string is set as a segment of the given channel (default: 'ipc'),
+-- 'nil' removes it. format: 'clubar.every(interval, function [, channel])'.
+clubar.every(5, function()
+    local f = io.open("/proc/loadavg")
+    if not f then return nil end
+    local load = f:read("*n")
+    f:close()
+    return string.format("<Fg=#fa8> LOAD </Fg>%.2f ", load)
+end)
@@ -0,0 +1,41 @@
+/* Example producer plugin, the load average (in the 'ipc' channel), e.g.
+ *   $ cc -shared -fPIC -Ilib -o ~/.config/clubar/plugins/loadavg.so \
+ *        examples/loadavg.c
+ *   $ clubar --plugins ~/.config/clubar/plugins
+ * (only 'clubar/plugin.h' is needed, nothing is linked against clubar).
+ */
+#include <clubar/plugin.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static const ClubarHost *host;
+static int channel, fd = -1;
+
+// no allocations, the file is kept open, and the line is reused.
+static void tick(void *ctx)
+{
+    static char buffer[64], line[128];
+    ssize_t n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    (void)ctx;
+    if (n <= 0)
+        return;
+    buffer[n] = 0;
+    float load;
+    if (sscanf(buffer, "%f", &load) != 1)
+        return;
+    snprintf(line, sizeof(line), "<Fg=%s> LOAD %.2f </Fg>",
+             load > 4 ? "#f55" : "#8f8", load);
+    host->publish_segment(channel, "load", line);
+}
+
+int clubar_plugin_init(const ClubarHost *h)
+{
+    if (h->abi < 1 || (channel = h->channel("ipc")) < 0 ||
+        (fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC)) < 0)
+        return 1;
+    host = h;
+    return !h->every(5, tick, NULL);
+}
+
+void clubar_plugin_exit(void) { close(fd); }
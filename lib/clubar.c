@@ -1,5 +1,11 @@
 #include "clubar.h"
 #include "../src/config.h"
+#include <clubar/i3bar.h>
+#include <clubar/memo.h>
+#include <clubar/modules.h>
+#include <clubar/replay.h>
+#include <clubar/segments.h>
+#include <clubar/stats.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,9 +24,8 @@ static inline void create_config(CluBar *);
 static CliArgs local_cli_args = {0, NULL};
 CliArgs *cli_args             = &local_cli_args;
 
-static Block blks[2][MAX_BLKS];
-
-static char ConfigFile[1 << 10];
+static Block blks[MAX_CHANNELS][MAX_BLKS];
+static Segments segments[MAX_CHANNELS];
 
 void load_fonts_from_string(char *str, Config *c)
 {
@@ -43,6 +48,67 @@ void load_fonts_from_string(char *str, Config *c)
     }
 }
 
+// format: 'name:align[:source]' (e.g. 'cpu:right:/tmp/cpu.fifo', 'log:left:3'),
+// an existing channel (e.g. 'stdin') gets updated instead (keeping its source,
+// unless provided).
+bool load_channel_from_string(const char *str, Config *c)
+{
+    ChannelSpec spec = {0};
+    char align[16]   = {0};
+    int cursor       = 0;
+
+    if (sscanf(str, "%31[^:]:%15[^:]%n", spec.name, align, &cursor) != 2)
+        return false;
+    for (spec.align = 0; spec.align < NullAlignment; ++spec.align)
+        if (strcmp(AlignmentRepr[spec.align], align) == 0)
+            break;
+    if (spec.align == NullAlignment)
+        return false;
+    if (str[cursor] == ':')
+        snprintf(spec.source, sizeof(spec.source), "%s", str + cursor + 1);
+    else if (str[cursor])
+        return false;
+
+    int i = 0;
+    while (i < c->nchannels && strcmp(c->channels[i].name, spec.name) != 0)
+        ++i;
+    if (i == MAX_CHANNELS)
+        return false;
+    if (i < c->nchannels && !strlen(spec.source))
+        strcpy(spec.source, c->channels[i].source);
+    c->nchannels   = i == c->nchannels ? i + 1 : c->nchannels;
+    c->channels[i] = spec;
+    return true;
+}
+
+// format: 'name:markup' (e.g. 'warn:<Fg=#f00><Bg=#222>'), an existing style
+// gets updated instead.
+bool load_style_from_string(const char *str, Config *c)
+{
+    StyleSpec spec = {0};
+    int cursor     = 0;
+    if (sscanf(str, "%31[^:]:%n", spec.name, &cursor) != 1 || !cursor)
+        return false;
+    snprintf(spec.markup, sizeof(spec.markup), "%s", str + cursor);
+
+    int i = 0;
+    while (i < c->nstyles && strcmp(c->styles[i].name, spec.name) != 0)
+        ++i;
+    if (i == MAX_STYLES)
+        return false;
+    c->nstyles   = i == c->nstyles ? i + 1 : c->nstyles;
+    c->styles[i] = spec;
+    return true;
+}
+
+BlockType clubar_channel(const CluBar *clubar, const char *name)
+{
+    for (BlockType blktype = 0; blktype < clubar->config.nchannels; ++blktype)
+        if (strcmp(clubar->config.channels[blktype].name, name) == 0)
+            return blktype;
+    return -1;
+}
+
 #define CONFIG_GEOMETRY   "geometry"
 #define CONFIG_PADDING    "padding"
 #define CONFIG_MARGIN     "margin"
@@ -51,6 +117,21 @@ void load_fonts_from_string(char *str, Config *c)
 #define CONFIG_FOREGROUND "foreground"
 #define CONFIG_BACKGROUND "background"
 #define CONFIG_FONTS      "fonts"
+#define CONFIG_MODULE     "module"
+#define CONFIG_CHANNEL    "channel"
+#define CONFIG_STYLE      "style"
+#define CONFIG_SOCKET     "socket"
+#define CONFIG_PLUGINS    "plugins"
+#define CONFIG_RECORD     "record"
+#define CONFIG_REPLAY     "replay"
+#define CONFIG_SPEED      "speed"
+#define CONFIG_MAX        "max"
+#define CONFIG_STATS      "stats"
+#define CONFIG_OUTPUTS    "outputs"
+#define CONFIG_COALESCE   "coalesce"
+#define CONFIG_CACHEFLOOR "cache-floor"
+#define CONFIG_I3BAR      "i3bar"
+#define CONFIG_SHM        "shm"
 
 static inline void usage(void)
 { // clang-format off
@@ -75,6 +156,46 @@ static inline void usage(void)
     puts("                  set default background color.");
     puts("  --" CONFIG_FONTS " values");
     puts("                  comma seperated fonts (eg: 'arial-10,monospace-10:bold').");
+    puts("  --" CONFIG_MODULE " name[:interval[:format]]");
+    puts("                  enable a native status module (repeatable), drawn left of");
+    puts("                  WM_NAME. modules: clock, cpu, memory, battery, network,");
+    puts("                  workspaces, window (the last two follow EWMH properties).");
+    puts("                  '%s' in format is the module value (clock: strftime format).");
+    puts("  --" CONFIG_CHANNEL " name:align[:source]");
+    puts("                  add an input channel (repeatable), 'align' is one of left,");
+    puts("                  center or right, 'source' is an fd number or a fifo path");
+    puts("                  (eg: 'cpu:right:/tmp/cpu.fifo'). builtin channels 'stdin',");
+    puts("                  'wm_name' and 'modules' can be realigned the same way.");
+    puts("  --" CONFIG_STYLE " name:markup");
+    puts("                  define a style (repeatable), '<Style=name>' expands to the");
+    puts("                  tags of 'markup' (eg: 'warn:<Fg=#f00><Box:Bottom=#f00:2>').");
+    puts("  --" CONFIG_PLUGINS " dir");
+    puts("                  load the producer plugins ('*.so') of a directory, at");
+    puts("                  startup (see 'clubar/plugin.h').");
+    puts("  --" CONFIG_SOCKET " path");
+    puts("                  listen for segment updates on a unix socket, commands:");
+    puts("                  'set <segment> <text>', 'del <segment>',");
+    puts("                  'fill <segment> <var> <text>' and");
+    puts("                  'push <graph> <value>' (one per line).");
+    puts("  --" CONFIG_RECORD " file");
+    puts("                  log every stdin line and WM_NAME change (with timestamps).");
+    puts("  --" CONFIG_REPLAY " file [--" CONFIG_SPEED " N|--" CONFIG_MAX "]");
+    puts("                  replay a recorded session (instead of reading stdin/WM_NAME)");
+    puts("                  at N times the recorded speed (default: 1), or as fast as");
+    puts("                  possible with '--" CONFIG_MAX "' (exits when done).");
+    puts("  --" CONFIG_STATS "         print runtime statistics on exit.");
+    puts("  --" CONFIG_OUTPUTS "       a bar on every (RandR) output, following hotplugs");
+    puts("                  (geometry is derived from the output and margins).");
+    puts("  --" CONFIG_COALESCE " ms");
+    puts("                  window for coalescing repeated actions that use '%n' in");
+    puts("                  their command (run once, '%n' being the count), 0 disables.");
+    puts("  --" CONFIG_CACHEFLOOR " kb");
+    puts("                  while the bar is hidden (or obscured), shrink the image");
+    puts("                  cache down to 'kb' kilobytes (default: left as is).");
+    puts("  --" CONFIG_I3BAR "         stdin speaks the i3bar (JSON) protocol (e.g. i3status),");
+    puts("                  clicks are written to stdout (if enabled by the header).");
+    puts("  --" CONFIG_SHM "           rasterize on the client into shared memory (MIT-SHM),");
+    puts("                  e.g. for VNC, falls back to XRender if unavailable.");
     puts("SIGNALS:");
     puts("  USR1: toggle window visibility (e.g. pkill -USR1 clubar).");
     puts("  USR2: Reload configurations from external config file without reloading.");
@@ -95,6 +216,21 @@ static inline void argparse(CluBar *clubar)
         {CONFIG_FOREGROUND, required_argument,  0,          0   },
         {CONFIG_BACKGROUND, required_argument,  0,          0   },
         {CONFIG_FONTS,      required_argument,  0,          0   },
+        {CONFIG_MODULE,     required_argument,  0,          0   },
+        {CONFIG_CHANNEL,    required_argument,  0,          0   },
+        {CONFIG_STYLE,      required_argument,  0,          0   },
+        {CONFIG_SOCKET,     required_argument,  0,          0   },
+        {CONFIG_PLUGINS,    required_argument,  0,          0   },
+        {CONFIG_RECORD,     required_argument,  0,          0   },
+        {CONFIG_REPLAY,     required_argument,  0,          0   },
+        {CONFIG_SPEED,      required_argument,  0,          0   },
+        {CONFIG_MAX,        no_argument,        0,          0   },
+        {CONFIG_STATS,      no_argument,        &c->stats,  1   },
+        {CONFIG_OUTPUTS,    no_argument,        &c->outputs, 1  },
+        {CONFIG_I3BAR,      no_argument,        &c->i3bar,  1   },
+        {CONFIG_SHM,        no_argument,        &c->shm,    1   },
+        {CONFIG_COALESCE,   required_argument,  0,          0   },
+        {CONFIG_CACHEFLOOR, required_argument,  0,          0   },
         {"help",            no_argument,        0,          'h' },
         {"version",         no_argument,        0,          'v' },
         {"config",          required_argument,  0,          'c' },
@@ -116,6 +252,8 @@ static inline void argparse(CluBar *clubar)
             c->topbar = 1;
         } break;
         case 0: {
+            if (strcmp(CONFIG_MAX, opts[i].name) == 0)
+                c->replay_speed = 0;
             if (optarg) {
                 if (strcmp(CONFIG_GEOMETRY, opts[i].name) == 0) {
                     if (sscanf(optarg, "%u,%u,%u,%u", &c->geometry.x,
@@ -139,13 +277,49 @@ static inline void argparse(CluBar *clubar)
                     c->border_width =
                         parse_color_string(optarg, c->border_color);
                 } else if (strcmp("config", opts[i].name) == 0) {
-                    strcpy(ConfigFile, optarg);
+                    strcpy(c->config_file, optarg);
                 } else if (strcmp(CONFIG_FOREGROUND, opts[i].name) == 0) {
                     strcpy(c->foreground, optarg);
                 } else if (strcmp(CONFIG_BACKGROUND, opts[i].name) == 0) {
                     strcpy(c->background, optarg);
                 } else if (strcmp(CONFIG_FONTS, opts[i].name) == 0) {
                     load_fonts_from_string(optarg, c);
+                } else if (strcmp(CONFIG_MODULE, opts[i].name) == 0) {
+                    if (!load_module_from_string(optarg, c))
+                        die("Invalid value for argument: '" CONFIG_MODULE
+                            "'.\n");
+                } else if (strcmp(CONFIG_CHANNEL, opts[i].name) == 0) {
+                    if (!load_channel_from_string(optarg, c))
+                        die("Invalid value for argument: '" CONFIG_CHANNEL
+                            "'.\n");
+                } else if (strcmp(CONFIG_STYLE, opts[i].name) == 0) {
+                    if (!load_style_from_string(optarg, c))
+                        die("Invalid value for argument: '" CONFIG_STYLE
+                            "'.\n");
+                } else if (strcmp(CONFIG_PLUGINS, opts[i].name) == 0) {
+                    snprintf(c->plugin_dir, sizeof(c->plugin_dir), "%s",
+                             optarg);
+                } else if (strcmp(CONFIG_SOCKET, opts[i].name) == 0) {
+                    snprintf(c->socket_file, sizeof(c->socket_file), "%s",
+                             optarg);
+                } else if (strcmp(CONFIG_RECORD, opts[i].name) == 0) {
+                    strcpy(c->record_file, optarg);
+                } else if (strcmp(CONFIG_REPLAY, opts[i].name) == 0) {
+                    strcpy(c->replay_file, optarg);
+                } else if (strcmp(CONFIG_COALESCE, opts[i].name) == 0) {
+                    if (sscanf(optarg, "%u", &c->coalesce_ms) != 1)
+                        die("Invalid value for argument: '" CONFIG_COALESCE
+                            "'.\n");
+                } else if (strcmp(CONFIG_CACHEFLOOR, opts[i].name) == 0) {
+                    if (sscanf(optarg, "%d", &c->cache_floor_kb) != 1 ||
+                        c->cache_floor_kb < 0)
+                        die("Invalid value for argument: '" CONFIG_CACHEFLOOR
+                            "'.\n");
+                } else if (strcmp(CONFIG_SPEED, opts[i].name) == 0) {
+                    if (sscanf(optarg, "%lf", &c->replay_speed) != 1 ||
+                        c->replay_speed <= 0)
+                        die("Invalid value for argument: '" CONFIG_SPEED
+                            "'.\n");
                 }
             }
         } break;
@@ -163,6 +337,21 @@ static inline void argparse(CluBar *clubar)
 #undef CONFIG_FOREGROUND
 #undef CONFIG_BACKGROUND
 #undef CONFIG_FONTS
+#undef CONFIG_MODULE
+#undef CONFIG_CHANNEL
+#undef CONFIG_STYLE
+#undef CONFIG_SOCKET
+#undef CONFIG_PLUGINS
+#undef CONFIG_RECORD
+#undef CONFIG_REPLAY
+#undef CONFIG_SPEED
+#undef CONFIG_MAX
+#undef CONFIG_STATS
+#undef CONFIG_OUTPUTS
+#undef CONFIG_COALESCE
+#undef CONFIG_CACHEFLOOR
+#undef CONFIG_I3BAR
+#undef CONFIG_SHM
 
 static inline void create_config(CluBar *clubar)
 {
@@ -178,31 +367,190 @@ static inline void create_config(CluBar *clubar)
         parse_color_string(border, clubar->config.border_color);
     strcpy(clubar->config.foreground, foreground);
     strcpy(clubar->config.background, background);
+    clubar->config.replay_speed   = 1;
+    clubar->config.coalesce_ms    = coalesce_ms;
+    clubar->config.cache_floor_kb = -1;
+    for (size_t i = 0; i < sizeof(styles) / sizeof(*styles); ++i)
+        load_style_from_string(styles[i], &clubar->config);
+    // stdin on the left and WM_NAME on the right, with modules next to it.
+    load_channel_from_string("stdin:left:0", &clubar->config);
+    load_channel_from_string("wm_name:right", &clubar->config);
+    load_channel_from_string("modules:right", &clubar->config);
+    load_channel_from_string("ipc:right", &clubar->config);
 }
 
 void clubar_init(CluBar *clubar)
 {
-    clubar->blks[Stdin]  = blks[Stdin];
-    clubar->blks[Custom] = blks[Custom];
+    for (BlockType blktype = 0; blktype < MAX_CHANNELS; ++blktype)
+        clubar->blks[blktype] = blks[blktype];
     create_config(clubar);
     argparse(clubar);
+    if (strlen(clubar->config.record_file) &&
+        !record_open(clubar->config.record_file))
+        die("Unable to open record file: '%s'.\n", clubar->config.record_file);
 }
 
-void clubar_load_external_configs(CluBar *clubar)
+static inline bool fonts_equal(const Config *a, const Config *b)
 {
-    blks_free(clubar->blks[Stdin], MAX_BLKS);
-    blks_free(clubar->blks[Custom], MAX_BLKS);
+    if (a->nfonts != b->nfonts)
+        return false;
+    for (int i = 0; i < a->nfonts; ++i)
+        if (strcmp(a->fonts[i], b->fonts[i]) != 0)
+            return false;
+    return true;
+}
+
+// Merges the external configs, and reports what actually changed, so that the
+// frontend can leave the rest (fonts, colors, blocks etc) alone.
+ConfigChanges clubar_load_external_configs(CluBar *clubar)
+{
+    Config *c = &clubar->config, old = *c;
+    ConfigChanges changes = 0x0;
+    // fonts are reallocated by the merges.
+    old.fonts = malloc(old.nfonts * sizeof(char *));
+    for (int i = 0; i < old.nfonts; ++i)
+        old.fonts[i] = strdup(c->fonts[i]);
 
 #ifdef __ENABLE_PLUGIN__xrmconfig__
-    xrmconfig_merge(&clubar->config);
+    xrmconfig_merge(c);
 #endif
 #ifdef __ENABLE_PLUGIN__luaconfig__
-    luaconfig_merge(ConfigFile, &clubar->config);
+    luaconfig_merge(c->config_file, c);
 #endif
+
+    if (!fonts_equal(&old, c))
+        changes |= 1 << ChangedFonts;
+    if (strcmp(old.foreground, c->foreground) != 0 ||
+        strcmp(old.background, c->background) != 0)
+        changes |= 1 << ChangedColors;
+    if (memcmp(&old.geometry, &c->geometry, sizeof(Geometry)) != 0 ||
+        memcmp(&old.padding, &c->padding, sizeof(Direction)) != 0)
+        changes |= 1 << ChangedGeometry;
+    if (old.topbar != c->topbar ||
+        memcmp(&old.margin, &c->margin, sizeof(Direction)) != 0)
+        changes |= 1 << ChangedStrut;
+    if (old.border_width != c->border_width ||
+        strcmp(old.border_color, c->border_color) != 0)
+        changes |= 1 << ChangedBorder;
+    // styles are parsed here (once per load), not on every line.
+    blks_clear_styles();
+    for (int i = 0; i < c->nstyles; ++i)
+        blks_add_style(c->styles[i].name, c->styles[i].markup);
+    // memoized blocks (and layouts) were made with the old styles (and fonts).
+    memo_clear();
+    memset(clubar->memo, 0, sizeof(clubar->memo));
+
+    for (int i = 0; i < old.nfonts; ++i)
+        free(old.fonts[i]);
+    free(old.fonts);
+    return changes;
 }
 
-void clubar_update_blks(CluBar *clubar, BlockType blktype, const char *buffer)
+// newest (raw) line of every channel, while the updates are deferred (the
+// buffers are kept around, for the next time).
+static struct {
+    char *line;
+    size_t capacity;
+    bool pending;
+} deferred[MAX_CHANNELS];
+
+static inline void parse_blks(CluBar *clubar, BlockType blktype,
+                              const char *buffer)
 {
     blks_free(clubar->blks[blktype], MAX_BLKS);
-    clubar->nblks[blktype] = blks_create(clubar->blks[blktype], buffer);
+    segments[blktype].nsegments = 0;
+    STATS_TIMED(StatParse)
+    {
+        clubar->nblks[blktype] = memo_blks(blktype, clubar->blks[blktype],
+                                           buffer, &clubar->memo[blktype]);
+    }
+    deferred[blktype].pending = false;
+}
+
+void clubar_update_blks(CluBar *clubar, BlockType blktype, const char *buffer)
+{
+    record_write(clubar->config.channels[blktype].name, buffer);
+    parse_blks(clubar, blktype, buffer);
+}
+
+// only the newest line is kept (unparsed), until 'clubar_flush_deferred'.
+void clubar_defer_blks(CluBar *clubar, BlockType blktype, const char *buffer)
+{
+    size_t size = strlen(buffer) + 1;
+    record_write(clubar->config.channels[blktype].name, buffer);
+    if (size > deferred[blktype].capacity) {
+        char *line = realloc(deferred[blktype].line, size);
+        if (!line)
+            return;
+        deferred[blktype].line = line, deferred[blktype].capacity = size;
+    }
+    memcpy(deferred[blktype].line, buffer, size);
+    deferred[blktype].pending = true;
+}
+
+// the blocks of unchanged entries (of the latest i3bar status line) are kept.
+void clubar_update_i3bar(CluBar *clubar, BlockType blktype)
+{
+    segments[blktype].nsegments = 0;
+    clubar->memo[blktype]       = NULL;
+    STATS_TIMED(StatParse)
+    {
+        clubar->nblks[blktype] =
+            i3bar_blks(clubar->blks[blktype], clubar->nblks[blktype]);
+    }
+    deferred[blktype].pending = false;
+}
+
+// parses the deferred lines, returns whether there were any.
+bool clubar_flush_deferred(CluBar *clubar)
+{
+    bool flushed = false;
+    for (BlockType blktype = 0; blktype < clubar->config.nchannels; ++blktype)
+        if (deferred[blktype].pending) {
+            parse_blks(clubar, blktype, deferred[blktype].line);
+            flushed = true;
+        }
+    // the latest i3bar status line is kept (unparsed) by 'i3bar' itself.
+    if (clubar->config.i3bar && i3bar_changed()) {
+        clubar_update_i3bar(clubar, Stdin);
+        flushed = true;
+    }
+    return flushed;
+}
+
+// only the segment's blocks are (re)parsed, the rest are left as is.
+void clubar_update_segment(CluBar *clubar, BlockType blktype, const char *name,
+                           const char *buffer)
+{
+    // the segment goes on top of the (deferred) line that came before it.
+    if (deferred[blktype].pending)
+        parse_blks(clubar, blktype, deferred[blktype].line);
+    clubar->memo[blktype] = NULL; // the blocks no longer match the line.
+    STATS_TIMED(StatParse)
+    {
+        clubar->nblks[blktype] =
+            buffer ? segments_set(&segments[blktype], clubar->blks[blktype],
+                                  clubar->nblks[blktype], name, buffer)
+                   : segments_remove(&segments[blktype], clubar->blks[blktype],
+                                     clubar->nblks[blktype], name);
+    }
+}
+
+// the segment's blocks are kept as is, just the placeholders get new text.
+int clubar_fill_segment(CluBar *clubar, BlockType blktype, const char *name,
+                        const char *var, const char *value)
+{
+    clubar->memo[blktype] = NULL;
+    return segments_fill(&segments[blktype], clubar->blks[blktype], name, var,
+                         value);
+}
+
+void clubar_destroy(CluBar *clubar)
+{
+    for (BlockType blktype = 0; blktype < MAX_CHANNELS; ++blktype)
+        free(deferred[blktype].line);
+    memo_clear();
+    record_close();
+    if (clubar->config.stats)
+        stats_dump(stderr);
 }
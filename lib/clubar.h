@@ -7,7 +7,9 @@
 #include <stdio.h>
 #include <string.h>
 
-#define MAX_BLKS (1 << 6)
+#define MAX_BLKS     (1 << 6)
+#define MAX_MODULES  (1 << 4)
+#define MAX_CHANNELS (1 << 4)
 
 #define IS_SET(value, mask) (((value) & (mask)) != 0)
 
@@ -18,7 +20,41 @@
         exit(1);                                                               \
     }
 
-typedef enum { Stdin, Custom } BlockType;
+// A 'BlockType' is the index of an input channel, the builtin channels always
+// come first, followed by the ones added with configs.
+typedef int BlockType;
+enum { Stdin, Custom, Modules, Ipc, NullBuiltinChannel };
+
+typedef enum { AlignLeft, AlignCenter, AlignRight, NullAlignment } Alignment;
+static const char *const AlignmentRepr[NullAlignment] = {
+    [AlignLeft]   = "left",
+    [AlignCenter] = "center",
+    [AlignRight]  = "right",
+};
+
+typedef struct {
+    char name[32];
+    Alignment align;
+    // fd number or path to a fifo (created if missing), empty if the channel
+    // isn't read by the input thread (e.g. WM_NAME).
+    char source[1 << 8];
+} ChannelSpec;
+
+// Frontend provided callback, for producers to update (and redraw) blocks.
+typedef void (*Publisher)(BlockType, const char *);
+// same as 'Publisher', for a single (named) segment of a channel (a NULL line
+// removes the segment).
+typedef void (*SegmentPublisher)(BlockType, const char *, const char *);
+// appends a sample to a (named) graph, redrawing only the graph.
+typedef void (*SamplePublisher)(const char *, double);
+// fills the placeholder (3rd arg) of a segment (2nd arg), with plain text.
+typedef void (*FillPublisher)(BlockType, const char *, const char *,
+                              const char *);
+
+// tags a '<Style=name>' expands to (e.g. '<Fg=#f00><Box:Bottom=#f00:2>').
+typedef struct {
+    char name[32], markup[1 << 8];
+} StyleSpec;
 
 typedef struct {
     uint32_t x, y, w, h;
@@ -42,6 +78,11 @@ static inline int parse_color_string(const char *val, char color[32])
     return size + (size <= 0);
 }
 
+typedef struct {
+    char name[16], format[1 << 8];
+    double interval;
+} ModuleSpec;
+
 typedef struct {
     int nfonts;
     char **fonts;
@@ -51,8 +92,34 @@ typedef struct {
     unsigned int border_width;
     char border_color[32];
     char foreground[16], background[16];
+    int nmodules;
+    ModuleSpec modules[MAX_MODULES];
+    int nchannels;
+    ChannelSpec channels[MAX_CHANNELS];
+    int nstyles;
+    StyleSpec styles[MAX_STYLES];
+    char plugin_dir[1 << 10]; // '*.so' producer plugins (loaded at startup).
+    // cli only options.
+    int stats, outputs, i3bar, shm;
+    unsigned int coalesce_ms;
+    int cache_floor_kb; // -1 => caches aren't trimmed while hidden.
+    char config_file[1 << 10];
+    char record_file[1 << 10], replay_file[1 << 10], socket_file[1 << 8];
+    double replay_speed; // 0 => replay as fast as possible.
 } Config;
 
+// parts of the config, that a reload might have changed.
+typedef enum {
+    ChangedFonts,
+    ChangedColors,
+    ChangedGeometry,
+    ChangedStrut,
+    ChangedBorder,
+    NullConfigChange
+} ConfigChange;
+typedef uint32_t ConfigChanges;
+#define ALL_CONFIG_CHANGES ((1 << NullConfigChange) - 1)
+
 struct CliArgs {
     int argc;
     const char **argv;
@@ -61,20 +128,32 @@ typedef struct CliArgs CliArgs;
 extern CliArgs *cli_args;
 
 typedef struct CluBar {
-    Block *blks[2];
-    int nblks[2];
+    Block *blks[MAX_CHANNELS];
+    int nblks[MAX_CHANNELS];
+    // memoized line the blocks came from, NULL if none (see 'clubar/memo.h').
+    struct MemoEntry *memo[MAX_CHANNELS];
     Config config;
 } CluBar;
 
 typedef struct CluBar CluBar;
 
 void load_fonts_from_string(char *, Config *);
+bool load_channel_from_string(const char *, Config *);
+bool load_style_from_string(const char *, Config *);
+BlockType clubar_channel(const CluBar *, const char *);
 
 #define GUARD(lock_expr, unlock_expr)                                          \
     for (int __cond = ((lock_expr), 1); __cond; __cond = ((unlock_expr), 0))
 
 void clubar_init(CluBar *);
-void clubar_load_external_configs(CluBar *);
+ConfigChanges clubar_load_external_configs(CluBar *);
 void clubar_update_blks(CluBar *, BlockType, const char *);
+void clubar_defer_blks(CluBar *, BlockType, const char *);
+bool clubar_flush_deferred(CluBar *);
+void clubar_update_i3bar(CluBar *, BlockType);
+void clubar_update_segment(CluBar *, BlockType, const char *, const char *);
+int clubar_fill_segment(CluBar *, BlockType, const char *, const char *,
+                        const char *);
+void clubar_destroy(CluBar *);
 
 #endif
@@ -1,4 +1,5 @@
 #include "blocks.h"
+#include <clubar/probes.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,12 +36,36 @@ typedef struct Parser {
     (p_peek(p) && memcmp(str, p_buffer(p), (len)) == 0 &&                      \
      p_advance_by(p, (len)) > 0)
 
+// Styles (e.g. '<Style=warn> ... </Style>') are parsed once (on config load),
+// and opening one just pushes its (already parsed) tags.
+typedef struct StyleTags {
+    char name[32];
+    Tag *tags[NullTagName];
+} StyleTags;
+
+static StyleTags styles[MAX_STYLES];
+static int nstyles = 0;
+
 static inline TagName parse_tagname(Parser *);
 static inline TagModifierMask parse_tagmodifier(Parser *, TagName);
 static inline bool parse_tag(Parser *, TagToken *);
 static inline void createblk(Block *, Tag *const[NullTagName], const char *,
                              int);
 
+// splits the value (in place) into nul separated words, so that the command
+// doesn't have to be tokenized on every click.
+static inline void tokenize(char *val)
+{
+    char *save, *word;
+    int len, n = 0;
+    for (word = strtok_r(val, " ", &save); word;
+         word = strtok_r(NULL, " ", &save)) {
+        memmove(val + n, word, len = strlen(word) + 1);
+        n += len;
+    }
+    memset(val + n, 0, BLK_BUFFER_SIZE - n);
+}
+
 static inline TagName parse_tagname(Parser *parser)
 {
     for (TagName tag_name = 0; tag_name < NullTagName; ++tag_name) {
@@ -87,8 +112,13 @@ static inline bool parse_tag(Parser *p, TagToken *token)
             } while (p_consume(p, '|'));
         }
         TRYP(p_consume(p, '='));
-        for (int i = 0; p_peek(p) && *p_peek(p) != TagEnd[0]; ++i)
+        // leaving room for the terminating (empty) word, of action tags.
+        for (int i = 0; p_peek(p) && *p_peek(p) != TagEnd[0]; ++i) {
+            TRYP(i < BLK_BUFFER_SIZE - 2);
             token->val[i] = p_next(p);
+        }
+        if (ActionTags[token->tag_name])
+            tokenize(token->val);
     }
     return p_consume_string(p, TagEnd, ntag_end);
 #undef TRYP
@@ -100,11 +130,48 @@ static inline void createblk(Block *blk, Tag *const tags[NullTagName],
     memcpy(blk->text, text, ntext);
     if (ntext < BLK_BUFFER_SIZE)
         blk->text[ntext] = 0;
+    // style markers are of no use to the blocks (the styles are expanded).
     for (int i = 0; i < NullTagName; ++i)
-        blk->tags[i] = tag_clone(tags[i]);
+        blk->tags[i] = i == Style ? NULL : tag_clone(tags[i]);
 }
 
-int blks_create(Block *blks, const char *line)
+static inline const StyleTags *style_find(const char *name)
+{
+    for (int i = 0; i < nstyles; ++i)
+        if (strcmp(styles[i].name, name) == 0)
+            return &styles[i];
+    return NULL;
+}
+
+// pushes the tags of 'chain' (oldest first), on top of 'tag'.
+static inline Tag *push_chain(Tag *tag, const Tag *chain)
+{
+    if (!chain)
+        return tag;
+    return tag_create(push_chain(tag, chain->previous), chain->val,
+                      chain->tmod_mask);
+}
+
+// the style's name is kept (in 'tags[Style]'), to know what to pop on close.
+static inline void style_open(Tag *tags[NullTagName], const TagToken *token)
+{
+    const StyleTags *style = style_find(token->val);
+    tags[Style]            = tag_create(tags[Style], token->val, 0x0);
+    for (TagName name = 0; style && name < NullTagName; ++name)
+        tags[name] = push_chain(tags[name], style->tags[name]);
+}
+
+static inline void style_close(Tag *tags[NullTagName])
+{
+    const StyleTags *style = style_find(tags[Style]->val);
+    for (TagName name = 0; style && name < NullTagName; ++name)
+        for (const Tag *tag = style->tags[name]; tag; tag = tag->previous)
+            tags[name] = tag_remove(tags[name]);
+    tags[Style] = tag_remove(tags[Style]);
+}
+
+// At most 'max' blocks are created, the rest of the line is dropped.
+int blks_create(Block *blks, int max, const char *line)
 {
     Parser parser = PARSER(line, strlen(line));
     int nblks = 0, nbuf = 0;
@@ -112,13 +179,28 @@ int blks_create(Block *blks, const char *line)
     TagToken token;
     Tag *tags[NullTagName] = {0};
 
-    for (int c = parser.cursor; p_peek(&parser); c = parser.cursor) {
+    PROBE1(parse_start, line);
+    for (int c = parser.cursor; p_peek(&parser) && nblks < max;
+         c     = parser.cursor) {
         bool parse_success = parse_tag(&parser, &token),
-             invalid_close = token.closing && tags[token.tag_name] == NULL;
+             invalid_close = token.closing && (VoidTags[token.tag_name] ||
+                                               tags[token.tag_name] == NULL);
         if (parse_success && !invalid_close) {
             if (nbuf) // only create a block, if some text exits.
                 createblk(&blks[nblks++], tags, buf, nbuf);
-            nbuf                 = 0;
+            nbuf = 0;
+            if (VoidTags[token.tag_name]) {
+                if (nblks == max)
+                    break;
+                tags[token.tag_name] = tag_create(NULL, token.val, 0x0);
+                createblk(&blks[nblks++], tags, "", 0);
+                RemoveTag(tags[token.tag_name]);
+                continue;
+            }
+            if (token.tag_name == Style) {
+                token.closing ? style_close(tags) : style_open(tags, &token);
+                continue;
+            }
             tags[token.tag_name] = token.closing
                                        ? tag_remove(tags[token.tag_name])
                                        : tag_create(tags[token.tag_name],
@@ -126,15 +208,55 @@ int blks_create(Block *blks, const char *line)
         } else {
             p_rollback_to(&parser, c);
             buf[nbuf++] = p_next(&parser);
+            if (nbuf == BLK_BUFFER_SIZE) // text too long for a single block.
+                createblk(&blks[nblks++], tags, buf, nbuf), nbuf = 0;
         }
     }
-    if (nbuf) // only create a block, if some text exits.
+    if (nbuf && nblks < max) // only create a block, if some text exits.
         createblk(&blks[nblks++], tags, buf, nbuf);
     for (TagName name = 0; name < NullTagName; ++name)
         RemoveTag(tags[name]);
+    PROBE1(parse_end, nblks);
     return nblks;
 }
 
+// Only the opening tags of 'markup' make up the style (e.g.
+// '<Fg=#f00><Box:Bottom=#f00:2>'), text and other tags are ignored.
+bool blks_add_style(const char *name, const char *markup)
+{
+    Parser parser = PARSER(markup, strlen(markup));
+    TagToken token;
+    StyleTags *style = (StyleTags *)style_find(name);
+    if (!style) {
+        if (nstyles == MAX_STYLES || strlen(name) >= sizeof(style->name))
+            return false;
+        style = &styles[nstyles++];
+        strcpy(style->name, name);
+    }
+    for (TagName tag_name = 0; tag_name < NullTagName; ++tag_name)
+        RemoveTag(style->tags[tag_name]);
+
+    for (int c = parser.cursor; p_peek(&parser); c = parser.cursor) {
+        if (!parse_tag(&parser, &token)) {
+            p_rollback_to(&parser, c + 1);
+            continue;
+        }
+        if (!token.closing && !VoidTags[token.tag_name] &&
+            token.tag_name != Style)
+            style->tags[token.tag_name] = tag_create(
+                style->tags[token.tag_name], token.val, token.tmod_mask);
+    }
+    return true;
+}
+
+void blks_clear_styles(void)
+{
+    for (int i = 0; i < nstyles; ++i)
+        for (TagName tag_name = 0; tag_name < NullTagName; ++tag_name)
+            RemoveTag(styles[i].tags[tag_name]);
+    nstyles = 0;
+}
+
 void blks_free(Block *blks, int nblks)
 {
     for (int b = 0; b < nblks; ++b)
@@ -46,12 +46,16 @@
 
 #include <clubar/tags.h>
 
+#define MAX_STYLES (1 << 4)
+
 typedef struct {
     char text[BLK_BUFFER_SIZE];
     Tag *tags[NullTagName];
 } Block;
 
-int blks_create(Block *, const char *);
+int blks_create(Block *, int, const char *);
 void blks_free(Block *, int);
+bool blks_add_style(const char *, const char *);
+void blks_clear_styles(void);
 
 #endif
@@ -0,0 +1,42 @@
+#include "graphs.h"
+#include <stdio.h>
+#include <string.h>
+
+static GraphSamples graphs[MAX_GRAPHS];
+static int ngraphs = 0;
+
+GraphSamples *graph_get(const char *name)
+{
+    for (int i = 0; i < ngraphs; ++i)
+        if (strcmp(graphs[i].name, name) == 0)
+            return &graphs[i];
+    return NULL;
+}
+
+GraphSamples *graph_push(const char *name, double value)
+{
+    GraphSamples *graph = graph_get(name);
+    if (!graph) {
+        if (ngraphs == MAX_GRAPHS || strlen(name) >= sizeof(graph->name))
+            return NULL;
+        graph = &graphs[ngraphs++];
+        strcpy(graph->name, name);
+    }
+    graph->samples[graph->head++ % MAX_GRAPH_SAMPLES] = value;
+    if (graph->nsamples < MAX_GRAPH_SAMPLES)
+        graph->nsamples++;
+    return graph;
+}
+
+// 'name:width[:color[:max]]'.
+bool graph_spec(const char *val, GraphSpec *spec)
+{
+    memset(spec, 0, sizeof(*spec));
+    if (sscanf(val, "%31[^:]:%d:%31[^:]:%lf", spec->name, &spec->width,
+               spec->color, &spec->max) < 2 ||
+        spec->width <= 0)
+        return false;
+    if (spec->width > MAX_GRAPH_SAMPLES)
+        spec->width = MAX_GRAPH_SAMPLES;
+    return true;
+}
@@ -0,0 +1,39 @@
+/* Graphs are (named) ring buffers of numeric samples, drawn with the 'Graph'
+ * tag as 1px wide bars, latest sample on the right, e.g.
+ *   <Graph=cpu:60:#8f8:100>   latest 60 samples of 'cpu', scaled to 100.
+ * (scaled to the largest visible sample, if 'max' is omitted).
+ *
+ * Appending a sample is O(1), and doesn't re-parse the channel it's drawn in.
+ */
+#ifndef __CLUBAR__GRAPHS_H__
+#define __CLUBAR__GRAPHS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_GRAPHS        (1 << 4)
+#define MAX_GRAPH_SAMPLES (1 << 9)
+
+typedef struct GraphSamples {
+    char name[32];
+    double samples[MAX_GRAPH_SAMPLES];
+    uint32_t head, nsamples;
+} GraphSamples;
+
+typedef struct GraphSpec {
+    char name[32], color[32];
+    int width;
+    double max;
+} GraphSpec;
+
+// 'i'th latest sample (0 being the latest), 'i' < 'nsamples'.
+static inline double graph_sample(const GraphSamples *graph, uint32_t i)
+{
+    return graph->samples[(graph->head - 1 - i) % MAX_GRAPH_SAMPLES];
+}
+
+GraphSamples *graph_get(const char *);
+GraphSamples *graph_push(const char *, double);
+bool graph_spec(const char *, GraphSpec *);
+
+#endif
@@ -0,0 +1,409 @@
+#include "i3bar.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#define MAX_DEPTH (1 << 4)
+
+// Parser state (input thread only), the stream is parsed a byte at a time, so
+// a status line can be split across any number of reads.
+static struct {
+    char stack[MAX_DEPTH]; // '[' or '{', of the open containers.
+    int depth;
+    bool in_string, escape, scalar, expect_key;
+    int nhex; // hex digits left, of a '\u' escape.
+    uint32_t codepoint, surrogate;
+    char key[32], token[BLK_BUFFER_SIZE];
+    int ntoken;
+    I3BarEntry entry, line[MAX_I3BAR_ENTRIES];
+    int nline;
+} p = {0};
+
+// 'latest' is the last complete status line, and 'shown' the one the blocks
+// were made from ('owners' being the entry of every block, -1 for separators).
+static pthread_mutex_t i3bar_mutex = PTHREAD_MUTEX_INITIALIZER;
+static I3BarEntry latest[MAX_I3BAR_ENTRIES], shown[MAX_I3BAR_ENTRIES];
+static int nlatest = 0, nshown = 0;
+static int owners[MAX_BLKS], shown_blks[MAX_I3BAR_ENTRIES];
+static bool changed = false, click_events = false, clicked = false;
+
+#define ENTRY_STRING(field)                                                    \
+    {#field, offsetof(I3BarEntry, field), sizeof(((I3BarEntry *)0)->field)}
+static const struct {
+    const char *key;
+    size_t offset, size;
+} EntryStrings[] = {
+    ENTRY_STRING(full_text), ENTRY_STRING(name),       ENTRY_STRING(instance),
+    ENTRY_STRING(color),     ENTRY_STRING(background), ENTRY_STRING(border),
+};
+#undef ENTRY_STRING
+
+static const char *const BorderRepr[4] = {"border_top", "border_right",
+                                          "border_bottom", "border_left"};
+static const TagModifier BorderSides[4] = {Top, Right, Bottom, Left};
+
+static const char *const ModifierRepr[NullTagModifier] = {
+    [Shift] = "Shift", [Ctrl] = "Control", [Super] = "Mod1", [Alt] = "Mod4",
+};
+
+static inline char top(void)
+{
+    return p.depth > 0 && p.depth <= MAX_DEPTH ? p.stack[p.depth - 1] : 0;
+}
+
+// an entry of a status line, i.e. '[' '[' '{' (the header being '{').
+static inline bool in_entry(void)
+{
+    return p.depth == 3 && memcmp(p.stack, "[[{", 3) == 0;
+}
+
+static inline bool in_header(void) { return p.depth == 1 && top() == '{'; }
+
+// copies (at most) 'size' - 1 bytes, always nul terminated.
+static inline void copy(char *dst, const char *src, size_t size)
+{
+    size_t len = strnlen(src, size - 1);
+    memcpy(dst, src, len);
+    dst[len] = 0;
+}
+
+static inline void push(char c)
+{
+    if (p.ntoken < (int)sizeof(p.token) - 1)
+        p.token[p.ntoken++] = c;
+}
+
+// utf-8 encoding of a '\uXXXX' escape (surrogate pairs are combined).
+static inline void push_codepoint(uint32_t cp)
+{
+    if (cp >= 0xd800 && cp < 0xdc00) {
+        p.surrogate = cp;
+        return;
+    }
+    if (cp >= 0xdc00 && cp < 0xe000) {
+        if (!p.surrogate)
+            return;
+        cp = 0x10000 + ((p.surrogate - 0xd800) << 10) + (cp - 0xdc00);
+    }
+    p.surrogate = 0;
+    if (cp == 0)
+        return;
+    if (cp < 0x80) {
+        push(cp);
+    } else if (cp < 0x800) {
+        push(0xc0 | cp >> 6), push(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        push(0xe0 | cp >> 12), push(0x80 | (cp >> 6 & 0x3f));
+        push(0x80 | (cp & 0x3f));
+    } else {
+        push(0xf0 | cp >> 18), push(0x80 | (cp >> 12 & 0x3f));
+        push(0x80 | (cp >> 6 & 0x3f)), push(0x80 | (cp & 0x3f));
+    }
+}
+
+static inline void set_value(bool string)
+{
+    I3BarEntry *entry = &p.entry;
+    if (in_header() && strcmp(p.key, "click_events") == 0) {
+        pthread_mutex_lock(&i3bar_mutex);
+        click_events = !string && strcmp(p.token, "true") == 0;
+        pthread_mutex_unlock(&i3bar_mutex);
+    }
+    if (!in_entry())
+        return;
+    if (string) {
+        for (size_t i = 0; i < sizeof(EntryStrings) / sizeof(*EntryStrings);
+             ++i)
+            if (strcmp(p.key, EntryStrings[i].key) == 0)
+                copy((char *)entry + EntryStrings[i].offset, p.token,
+                     EntryStrings[i].size);
+        return;
+    }
+    for (int i = 0; i < 4; ++i)
+        if (strcmp(p.key, BorderRepr[i]) == 0)
+            entry->borders[i] = atoi(p.token);
+    if (strcmp(p.key, "separator") == 0)
+        entry->separator = strcmp(p.token, "false") != 0;
+    if (strcmp(p.key, "separator_block_width") == 0)
+        entry->separator_block_width = atoi(p.token);
+}
+
+// a string (or a scalar) just ended, as either a key or a value.
+static inline void token_end(bool string)
+{
+    p.token[p.ntoken] = 0;
+    if (string && p.expect_key && top() == '{')
+        copy(p.key, p.token, sizeof(p.key));
+    else
+        set_value(string);
+}
+
+static inline void string_char(char c)
+{
+    if (p.nhex) {
+        int digit = c >= '0' && c <= '9'   ? c - '0'
+                    : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                    : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                           : -1;
+        if (digit < 0) {
+            p.nhex = 0;
+            return;
+        }
+        p.codepoint = p.codepoint << 4 | digit;
+        if (--p.nhex == 0)
+            push_codepoint(p.codepoint);
+    } else if (p.escape) {
+        p.escape = false;
+        switch (c) {
+        case 'u': p.nhex = 4, p.codepoint = 0; break;
+        // the bar is a single line.
+        case 'n':
+        case 'r':
+        case 't': push(' '); break;
+        case 'b':
+        case 'f': break;
+        default: push(c); break;
+        }
+    } else if (c == '\\') {
+        p.escape = true;
+    } else if (c == '"') {
+        p.in_string = false;
+        token_end(true);
+    } else {
+        push(c);
+    }
+}
+
+static inline void open_container(char c)
+{
+    if (p.depth < MAX_DEPTH)
+        p.stack[p.depth] = c;
+    p.depth++;
+    p.expect_key = c == '{';
+    if (p.depth == 2 && memcmp(p.stack, "[[", 2) == 0)
+        p.nline = 0;
+    if (in_entry())
+        p.entry = (I3BarEntry){.borders               = {1, 1, 1, 1},
+                               .separator             = true,
+                               .separator_block_width = 9};
+}
+
+// returns whether a status line was completed.
+static inline bool close_container(void)
+{
+    bool complete = false;
+    if (in_entry() && p.nline < MAX_I3BAR_ENTRIES) {
+        p.line[p.nline++] = p.entry;
+    } else if (p.depth == 2 && memcmp(p.stack, "[[", 2) == 0) {
+        pthread_mutex_lock(&i3bar_mutex);
+        memcpy(latest, p.line, p.nline * sizeof(*p.line));
+        nlatest = p.nline, changed = true;
+        pthread_mutex_unlock(&i3bar_mutex);
+        complete = true;
+    }
+    p.depth -= p.depth > 0;
+    p.expect_key = false;
+    return complete;
+}
+
+// returns whether a (new) status line was completed.
+bool i3bar_feed(const char *buffer, size_t size)
+{
+    bool complete = false;
+    for (size_t i = 0; i < size; ++i) {
+        char c = buffer[i];
+        if (p.in_string) {
+            string_char(c);
+            continue;
+        }
+        if (p.scalar && c && strchr(",]} \t\r\n", c))
+            p.scalar = false, token_end(false);
+        switch (c) {
+        case '"': {
+            p.in_string = true, p.ntoken = 0, p.surrogate = 0;
+        } break;
+        case '{':
+        case '[': open_container(c); break;
+        case '}':
+        case ']': complete |= close_container(); break;
+        case ':': p.expect_key = false; break;
+        case ',': p.expect_key = top() == '{'; break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n': break;
+        default: {
+            if (!p.scalar)
+                p.scalar = true, p.ntoken = 0;
+            push(c);
+        } break;
+        }
+    }
+    return complete;
+}
+
+bool i3bar_changed(void)
+{
+    pthread_mutex_lock(&i3bar_mutex);
+    bool result = changed;
+    pthread_mutex_unlock(&i3bar_mutex);
+    return result;
+}
+
+// tag values are nul separated words (terminated by an empty word).
+static inline Tag *word_tag(Tag *previous, const char *val,
+                            TagModifierMask tmod_mask)
+{
+    char word[64] = {0};
+    copy(word, val, sizeof(word) - 1);
+    return tag_create(previous, word, tmod_mask);
+}
+
+static inline void entry_blk(Block *blk, const I3BarEntry *entry)
+{
+    char box[64];
+    TagModifierMask sides = 0x0;
+    memset(blk->tags, 0, sizeof(blk->tags));
+    snprintf(blk->text, sizeof(blk->text), "%s", entry->full_text);
+    if (*entry->color)
+        blk->tags[Fg] = word_tag(NULL, entry->color, 0x0);
+    if (*entry->background)
+        blk->tags[Bg] = word_tag(NULL, entry->background, 0x0);
+    // sides of the same width share a 'Box' tag.
+    for (int i = 0; *entry->border && i < 4; ++i) {
+        TagModifierMask mask = 0x0;
+        if (entry->borders[i] <= 0 || IS_SET(sides, 1 << BorderSides[i]))
+            continue;
+        for (int j = i; j < 4; ++j)
+            if (entry->borders[j] == entry->borders[i])
+                mask |= 1 << BorderSides[j];
+        sides |= mask;
+        snprintf(box, sizeof(box), "%s:%d", entry->border, entry->borders[i]);
+        blk->tags[Box] = word_tag(blk->tags[Box], box, mask);
+    }
+}
+
+// i3bar's default 'separator' color.
+#define SEPARATOR_COLOR "#666666"
+
+// a gap of 'separator_block_width' pixels after the entry (as with i3bar),
+// with a line in the middle, unless the entry asked for no separator.
+static inline bool separator_blk(Block *blk, const I3BarEntry *entry)
+{
+    char gap[64];
+    if (entry->separator_block_width <= 0)
+        return false;
+    snprintf(gap, sizeof(gap), entry->separator ? "%d:" SEPARATOR_COLOR : "%d",
+             entry->separator_block_width);
+    memset(blk->tags, 0, sizeof(blk->tags));
+    blk->text[0]   = 0;
+    blk->tags[Gap] = word_tag(NULL, gap, 0x0);
+    return true;
+}
+
+// entries are identified by 'name' and 'instance' (by position, without a
+// name).
+static inline int find_shown(const I3BarEntry *entry, int i,
+                             const bool taken[])
+{
+    for (int j = 0; j < nshown; ++j) {
+        if (taken[j])
+            continue;
+        if (*entry->name ? strcmp(shown[j].name, entry->name) == 0 &&
+                               strcmp(shown[j].instance, entry->instance) == 0
+                         : j == i)
+            return j;
+    }
+    return -1;
+}
+
+// Turns the latest status line into blocks, the blocks of unchanged entries
+// are reused as they are (no tags are created for them), returns the number
+// of blocks.
+int i3bar_blks(Block *blks, int nblks)
+{
+    static I3BarEntry entries[MAX_I3BAR_ENTRIES];
+    static Block next[MAX_BLKS];
+    int nentries, n = 0, entry_blks[MAX_I3BAR_ENTRIES],
+                  next_owners[MAX_BLKS];
+    bool taken[MAX_I3BAR_ENTRIES] = {0};
+
+    pthread_mutex_lock(&i3bar_mutex);
+    if (!changed) {
+        pthread_mutex_unlock(&i3bar_mutex);
+        return nblks;
+    }
+    memcpy(entries, latest, nlatest * sizeof(*latest));
+    nentries = nlatest, changed = false;
+    pthread_mutex_unlock(&i3bar_mutex);
+
+    for (int i = 0; i < nentries; ++i) {
+        const I3BarEntry *entry = &entries[i];
+        int j                   = find_shown(entry, i, taken);
+        if (i && separator_blk(&next[n], &entries[i - 1]))
+            next_owners[n++] = -1;
+        if (j >= 0)
+            taken[j] = true;
+        if (j >= 0 && shown_blks[j] < nblks &&
+            memcmp(entry, &shown[j], sizeof(*entry)) == 0) {
+            next[n] = blks[shown_blks[j]];
+            memset(blks[shown_blks[j]].tags, 0, sizeof(blks->tags));
+        } else {
+            entry_blk(&next[n], entry);
+        }
+        entry_blks[i] = n, next_owners[n++] = i;
+    }
+    blks_free(blks, MAX_BLKS);
+    memcpy(blks, next, n * sizeof(*next));
+
+    pthread_mutex_lock(&i3bar_mutex);
+    memcpy(shown, entries, nentries * sizeof(*entries));
+    memcpy(shown_blks, entry_blks, nentries * sizeof(*entry_blks));
+    memcpy(owners, next_owners, n * sizeof(*next_owners));
+    nshown = nentries;
+    pthread_mutex_unlock(&i3bar_mutex);
+    return n;
+}
+
+static inline void json_string(const char *key, const char *str)
+{
+    printf("\"%s\":\"", key);
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            printf("\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            printf("\\u%04x", *str);
+        else
+            putchar(*str);
+    }
+    fputs("\",", stdout);
+}
+
+// Clicks are written to stdout, as an infinite array (same as i3bar), returns
+// whether the click was written ('blk' being the index of the clicked block).
+bool i3bar_click(int blk, const I3BarClick *click)
+{
+    bool sent = false;
+    int n     = 0;
+    pthread_mutex_lock(&i3bar_mutex);
+    int i = blk >= 0 && blk < MAX_BLKS ? owners[blk] : -1;
+    if (click_events && i >= 0 && i < nshown) {
+        fputs(clicked ? ",{" : "[\n{", stdout);
+        if (*shown[i].name)
+            json_string("name", shown[i].name);
+        if (*shown[i].instance)
+            json_string("instance", shown[i].instance);
+        printf("\"button\":%d,\"modifiers\":[", click->button);
+        for (TagModifier tmod = 0; tmod < NullTagModifier; ++tmod)
+            if (ModifierRepr[tmod] && IS_SET(click->modifiers, 1 << tmod))
+                printf("%s\"%s\"", n++ ? "," : "", ModifierRepr[tmod]);
+        printf("],\"x\":%d,\"y\":%d,\"relative_x\":%d,\"relative_y\":%d,"
+               "\"width\":%d,\"height\":%d}\n",
+               click->x, click->y, click->relative_x, click->relative_y,
+               click->width, click->height);
+        fflush(stdout);
+        clicked = sent = true;
+    }
+    pthread_mutex_unlock(&i3bar_mutex);
+    return sent;
+}
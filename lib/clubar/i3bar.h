@@ -0,0 +1,38 @@
+/* i3bar (swaybar) protocol input, e.g. 'i3status | clubar --i3bar'.
+ * The infinite array of status lines is parsed incrementally (as bytes
+ * arrive), straight into blocks (no intermediate markup):
+ *   full_text         => text
+ *   color, background => 'Fg', 'Bg'
+ *   border[_*]        => 'Box' (border_top, border_right, ... default: 1)
+ *   name, instance    => identity of the block (for reuse and clicks)
+ * An entry that didn't change (same identity and values) keeps its block as
+ * is, and clicks are written (as JSON) to stdout, if the header asked for
+ * 'click_events'.
+ */
+#ifndef __CLUBAR__I3BAR_H__
+#define __CLUBAR__I3BAR_H__
+
+#include <clubar.h>
+
+#define MAX_I3BAR_ENTRIES ((MAX_BLKS + 1) / 2) // leaving room for separators.
+
+typedef struct I3BarEntry {
+    char name[32], instance[32], full_text[BLK_BUFFER_SIZE];
+    char color[32], background[32], border[32];
+    int borders[4]; // top, right, bottom, left.
+    bool separator;
+    int separator_block_width;
+} I3BarEntry;
+
+typedef struct I3BarClick {
+    int button;
+    TagModifierMask modifiers;
+    int x, y, relative_x, relative_y, width, height;
+} I3BarClick;
+
+bool i3bar_feed(const char *, size_t);
+bool i3bar_changed(void);
+int i3bar_blks(Block *, int);
+bool i3bar_click(int, const I3BarClick *);
+
+#endif
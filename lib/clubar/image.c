@@ -0,0 +1,110 @@
+#include "image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// next (whitespace separated) header token, skipping '#' comments.
+static inline bool next_token(FILE *fp, char *token, int size)
+{
+    int ch, n = 0;
+    while ((ch = fgetc(fp)) != EOF) {
+        if (ch == '#')
+            while ((ch = fgetc(fp)) != EOF && ch != '\n')
+                ;
+        else if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r') {
+            if (n)
+                break;
+        } else if (n < size - 1)
+            token[n++] = ch;
+    }
+    token[n] = 0;
+    return n > 0;
+}
+
+static inline bool read_pam_header(FILE *fp, int *w, int *h, int *depth,
+                                   int *maxval)
+{
+    char key[32], val[32];
+    while (next_token(fp, key, sizeof(key))) {
+        if (strcmp(key, "ENDHDR") == 0)
+            return true;
+        if (!next_token(fp, val, sizeof(val)))
+            return false;
+        if (strcmp(key, "WIDTH") == 0)
+            *w = atoi(val);
+        else if (strcmp(key, "HEIGHT") == 0)
+            *h = atoi(val);
+        else if (strcmp(key, "DEPTH") == 0)
+            *depth = atoi(val);
+        else if (strcmp(key, "MAXVAL") == 0)
+            *maxval = atoi(val);
+    }
+    return false;
+}
+
+static inline bool read_header(FILE *fp, int *w, int *h, int *depth,
+                               int *maxval)
+{
+    char token[32];
+    if (!next_token(fp, token, sizeof(token)))
+        return false;
+    if (strcmp(token, "P7") == 0)
+        return read_pam_header(fp, w, h, depth, maxval);
+    if (strcmp(token, "P6") != 0)
+        return false;
+    // the last token is followed by a single whitespace (already consumed).
+    int *fields[3] = {w, h, maxval};
+    for (int i = 0; i < 3; ++i) {
+        if (!next_token(fp, token, sizeof(token)))
+            return false;
+        *fields[i] = atoi(token);
+    }
+    return true;
+}
+
+static inline bool read_pixels(FILE *fp, int depth, int maxval, Image *image)
+{
+    int w = image->width, h = image->height;
+    uint8_t *row  = malloc((size_t)w * depth);
+    image->pixels = malloc((size_t)w * h * sizeof(uint32_t));
+    bool ok       = row && image->pixels;
+    for (int y = 0; ok && y < h; ++y) {
+        if (!(ok = fread(row, depth, w, fp) == (size_t)w))
+            break;
+        for (int x = 0; x < w; ++x) {
+            const uint8_t *p = row + x * depth;
+            uint32_t a = depth == 4 ? p[3] * 255 / maxval : 255,
+                     r = p[0] * 255 / maxval * a / 255,
+                     g = p[1] * 255 / maxval * a / 255,
+                     b = p[2] * 255 / maxval * a / 255;
+            image->pixels[y * w + x] = a << 24 | r << 16 | g << 8 | b;
+        }
+    }
+    free(row);
+    return ok;
+}
+
+bool image_load(const char *path, Image *image)
+{
+    int w = 0, h = 0, depth = 3, maxval = 0;
+    FILE *fp = fopen(path, "rb");
+    bool ok  = false;
+    *image   = (Image){0};
+    if (fp && read_header(fp, &w, &h, &depth, &maxval) && w > 0 && h > 0 &&
+        w <= MAX_IMAGE_SIZE && h <= MAX_IMAGE_SIZE && maxval > 0 &&
+        maxval <= 255 && (depth == 3 || depth == 4)) {
+        image->width = w, image->height = h;
+        ok = read_pixels(fp, depth, maxval, image);
+    }
+    if (fp)
+        fclose(fp);
+    if (!ok)
+        image_free(image);
+    return ok;
+}
+
+void image_free(Image *image)
+{
+    free(image->pixels);
+    *image = (Image){0};
+}
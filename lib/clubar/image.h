@@ -0,0 +1,26 @@
+/* Minimal image decoder, for the 'Img' tag: binary netpbm images, i.e. 'P6'
+ * (rgb) and 'P7' (rgb/rgb_alpha, with 'TUPLTYPE RGB_ALPHA'), e.g.
+ *   convert icon.png icon.pam   (ImageMagick, keeps the alpha channel)
+ *
+ * Pixels are decoded as premultiplied ARGB32 (native byte order), which is
+ * what XRender expects.
+ */
+#ifndef __CLUBAR__IMAGE_H__
+#define __CLUBAR__IMAGE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// width/height, in pixels, i.e. at most 1 MiB of pixels, well within what the
+// frontends cache (e.g. 4 MiB for 'with_x11'), larger ones aren't loaded.
+#define MAX_IMAGE_SIZE (1 << 9)
+
+typedef struct Image {
+    int width, height;
+    uint32_t *pixels;
+} Image;
+
+bool image_load(const char *, Image *);
+void image_free(Image *);
+
+#endif
@@ -0,0 +1,168 @@
+#include "ipc.h"
+#include "ring.h"
+#include "sched.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef struct IpcClient {
+    int fd, len;
+    char buffer[BLK_BUFFER_SIZE];
+} IpcClient;
+
+static struct {
+    int fd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    SegmentPublisher publish;
+    SamplePublisher publish_sample;
+    FillPublisher publish_fill;
+    IpcClient clients[MAX_IPC_CLIENTS];
+} ipc = {.fd = -1};
+
+// hands over the shared memory and the eventfd of a ring buffer channel.
+static inline void ipc_send_ring(int client, const char *name)
+{
+    int fds[2];
+    char byte = 0;
+    union {
+        struct cmsghdr hdr;
+        char buffer[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov  = {.iov_base = &byte, .iov_len = 1};
+    struct msghdr msg = {.msg_iov        = &iov,
+                         .msg_iovlen     = 1,
+                         .msg_control    = control.buffer,
+                         .msg_controllen = sizeof(control.buffer)};
+    struct cmsghdr *cmsg;
+
+    if (!ring_fds(name, fds)) {
+        eprintf("No ring buffer channel named: '%s'.\n", name);
+        // producer gets a message without fds.
+        msg.msg_control = NULL, msg.msg_controllen = 0;
+    } else {
+        cmsg             = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+    if (sendmsg(client, &msg, MSG_NOSIGNAL) < 0)
+        eprintf("Unable to send ring buffer of channel: '%s'.\n", name);
+}
+
+static inline void ipc_execute(int client, char *line)
+{
+    char *save, *cmd = strtok_r(line, " ", &save),
+                *name = strtok_r(NULL, " ", &save),
+                *text = strtok_r(NULL, "", &save);
+    if (!cmd || !name)
+        return;
+    if (strcmp(cmd, "set") == 0)
+        ipc.publish(Ipc, name, text ? text : "");
+    else if (strcmp(cmd, "del") == 0)
+        ipc.publish(Ipc, name, NULL);
+    else if (strcmp(cmd, "fill") == 0) {
+        char *var   = text ? strtok_r(text, " ", &save) : NULL,
+             *value = var ? strtok_r(NULL, "", &save) : NULL;
+        if (var)
+            ipc.publish_fill(Ipc, name, var, value ? value : "");
+    } else if (strcmp(cmd, "push") == 0) {
+        char *end;
+        double value = text ? strtod(text, &end) : 0;
+        if (!text || end == text) {
+            eprintf("Invalid sample for graph '%s'.\n", name);
+        } else
+            ipc.publish_sample(name, value);
+    } else if (strcmp(cmd, "ring") == 0)
+        ipc_send_ring(client, name);
+    else
+        eprintf("Unknown ipc command: '%s'.\n", cmd);
+}
+
+static inline void client_close(IpcClient *client)
+{
+    sched_unwatch(client->fd);
+    close(client->fd);
+    client->fd = -1, client->len = 0;
+}
+
+static void client_read(void *ctx)
+{
+    IpcClient *client = (IpcClient *)ctx;
+    int size          = sizeof(client->buffer) - 1;
+    ssize_t n;
+    if ((n = read(client->fd, client->buffer + client->len,
+                  size - client->len)) <= 0) {
+        client_close(client);
+        return;
+    }
+    client->len += n;
+
+    char *start = client->buffer, *end;
+    while ((end = memchr(start, '\n', client->buffer + client->len - start))) {
+        *end = 0;
+        ipc_execute(client->fd, start);
+        start = end + 1;
+    }
+    client->len -= start - client->buffer;
+    memmove(client->buffer, start, client->len);
+    // a line that doesn't fit in the buffer, is dropped.
+    if (client->len == size)
+        client->len = 0;
+}
+
+static void client_accept(void *ctx)
+{
+    (void)ctx;
+    int fd = accept4(ipc.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+    for (int i = 0; i < MAX_IPC_CLIENTS; ++i) {
+        IpcClient *client = &ipc.clients[i];
+        if (client->fd < 0 && sched_watch(fd, client_read, client)) {
+            client->fd = fd, client->len = 0;
+            return;
+        }
+    }
+    eprintf("Too many ipc clients, closing connection.\n");
+    close(fd);
+}
+
+bool ipc_init(const char *path, SegmentPublisher publish,
+              SamplePublisher publish_sample, FillPublisher publish_fill)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, path);
+    // stale socket file (from a previous run).
+    unlink(path);
+    for (int i = 0; i < MAX_IPC_CLIENTS; ++i)
+        ipc.clients[i].fd = -1;
+
+    if ((ipc.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                         0)) < 0)
+        return false;
+    if (bind(ipc.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(ipc.fd, MAX_IPC_CLIENTS) < 0 ||
+        !sched_watch(ipc.fd, client_accept, NULL)) {
+        ipc_close();
+        return false;
+    }
+    strcpy(ipc.path, path);
+    ipc.publish = publish, ipc.publish_sample = publish_sample,
+    ipc.publish_fill = publish_fill;
+    return true;
+}
+
+void ipc_close(void)
+{
+    if (ipc.fd < 0)
+        return;
+    close(ipc.fd);
+    if (strlen(ipc.path))
+        unlink(ipc.path);
+    ipc.fd = -1;
+}
@@ -0,0 +1,26 @@
+/* Line based control protocol, over a unix (stream) socket.
+ *   set <segment> <text>   create/update a segment of the 'ipc' channel.
+ *   del <segment>          remove a segment of the 'ipc' channel.
+ *   fill <segment> <var> <text>
+ *                          set the text of the '<Var=var>' placeholders of a
+ *                          segment (the segment isn't re-parsed).
+ *   push <graph> <value>   append a sample to a graph (see 'graphs.h').
+ *   ring <channel>         get the ring buffer of a channel (see 'ringbuf.h').
+ * e.g.
+ *   echo 'set cpu <Fg=red>93%</Fg>' | socat - UNIX-CONNECT:/tmp/clubar.sock
+ *
+ * Segments are drawn in the order they were created, and only the updated
+ * segment gets re-parsed.
+ */
+#ifndef __CLUBAR__IPC_H__
+#define __CLUBAR__IPC_H__
+
+#include <clubar.h>
+
+#define MAX_IPC_CLIENTS (1 << 4)
+
+bool ipc_init(const char *, SegmentPublisher, SamplePublisher,
+              FillPublisher);
+void ipc_close(void);
+
+#endif
@@ -0,0 +1,99 @@
+#include "loader.h"
+#include "plugin.h"
+#include "sched.h"
+#include <dirent.h>
+#include <dlfcn.h>
+#include <stdlib.h>
+
+static void *handles[MAX_PLUGINS];
+static int nhandles                       = 0;
+static const CluBar *host_clubar          = NULL;
+static Publisher publisher                = NULL;
+static SegmentPublisher segment_publisher = NULL;
+
+static int host_channel(const char *name)
+{
+    return clubar_channel(host_clubar, name);
+}
+
+static bool host_publish(int channel, const char *line)
+{
+    if (channel < 0 || channel >= host_clubar->config.nchannels || !line)
+        return false;
+    publisher(channel, line);
+    return true;
+}
+
+static bool host_publish_segment(int channel, const char *segment,
+                                 const char *line)
+{
+    if (channel < 0 || channel >= host_clubar->config.nchannels || !segment)
+        return false;
+    segment_publisher(channel, segment, line);
+    return true;
+}
+
+static const ClubarHost host = {
+    .abi             = CLUBAR_PLUGIN_ABI,
+    .size            = sizeof(ClubarHost),
+    .channel         = host_channel,
+    .publish         = host_publish,
+    .publish_segment = host_publish_segment,
+    .every           = sched_every,
+    .watch           = sched_watch,
+    .unwatch         = sched_unwatch,
+};
+
+static int is_plugin(const struct dirent *e)
+{
+    size_t len = strlen(e->d_name);
+    return len > 3 && strcmp(e->d_name + len - 3, ".so") == 0;
+}
+
+// A plugin that fails to initialize is reported (and skipped), but isn't
+// unloaded, as it might have registered callbacks already.
+bool loader_init(const char *dir, const CluBar *clubar, Publisher publish,
+                 SegmentPublisher publish_segment)
+{
+    struct dirent **names;
+    char path[1 << 12];
+    int n = scandir(dir, &names, is_plugin, alphasort);
+    if (n < 0)
+        return false;
+    host_clubar = clubar, publisher = publish,
+    segment_publisher = publish_segment;
+
+    for (int i = 0; i < n; free(names[i++])) {
+        ClubarPluginInit init = NULL;
+        void *handle;
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]->d_name);
+        if (nhandles == MAX_PLUGINS) {
+            eprintf("Skipping plugin: '%s' (max: %d).\n", path, MAX_PLUGINS);
+            continue;
+        }
+        if (!(handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) ||
+            !(*(void **)&init = dlsym(handle, CLUBAR_PLUGIN_INIT))) {
+            eprintf("Unable to load plugin: '%s' (%s).\n", path, dlerror());
+            if (handle)
+                dlclose(handle);
+            continue;
+        }
+        if (init(&host) != 0) {
+            eprintf("Unable to initialize plugin: '%s'.\n", path);
+            continue;
+        }
+        handles[nhandles++] = handle;
+    }
+    free(names);
+    return true;
+}
+
+// called once the scheduler is done (no more callbacks).
+void loader_close(void)
+{
+    ClubarPluginExit fini = NULL;
+    for (int i = 0; i < nhandles; ++i)
+        if ((*(void **)&fini = dlsym(handles[i], CLUBAR_PLUGIN_EXIT)))
+            fini();
+    nhandles = 0;
+}
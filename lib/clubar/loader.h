@@ -0,0 +1,15 @@
+/* Runtime loaded producer plugins, every '*.so' in the plugin directory is
+ * loaded (in alphabetical order) once, at startup (see 'plugin.h' for the
+ * ABI).
+ */
+#ifndef __CLUBAR__LOADER_H__
+#define __CLUBAR__LOADER_H__
+
+#include <clubar.h>
+
+#define MAX_PLUGINS (1 << 4)
+
+bool loader_init(const char *, const CluBar *, Publisher, SegmentPublisher);
+void loader_close(void);
+
+#endif
@@ -0,0 +1,164 @@
+#include "memo.h"
+#include <clubar/stats.h>
+#include <stdlib.h>
+
+static struct {
+    MemoEntry *head; // most recently used first.
+    int nentries;
+    size_t size;
+    // evicted entries (with their buffers), to be recycled, there are at most
+    // 'MAX_MEMO_ENTRIES' entries of a channel in all.
+    MemoEntry *spare;
+} memos[MAX_CHANNELS];
+
+#define LRU_ATTACH(head, c)                                                    \
+    do {                                                                       \
+        if ((c->prev = NULL, c->next = head))                                  \
+            head->prev = c;                                                    \
+        head = c;                                                              \
+    } while (0)
+
+#define LRU_DETACH(head, c)                                                    \
+    do {                                                                       \
+        (void)(c->prev ? (c->prev->next = c->next) : (head = c->next));        \
+        (void)(c->next ? (c->next->prev = c->prev) : 0);                       \
+    } while (0)
+
+// FNV-1a, the line itself is only compared when the hashes match.
+static inline uint64_t hash(const char *line)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (const unsigned char *c = (const unsigned char *)line; *c; ++c)
+        h = (h ^ *c) * 1099511628211ull;
+    return h;
+}
+
+static inline void blk_copy(Block *dst, const Block *src)
+{
+    size_t ntext = strnlen(src->text, BLK_BUFFER_SIZE);
+    memcpy(dst->text, src->text, ntext);
+    if (ntext < BLK_BUFFER_SIZE)
+        dst->text[ntext] = 0;
+    for (TagName name = 0; name < NullTagName; ++name)
+        dst->tags[name] = tag_clone(src->tags[name]);
+}
+
+static inline size_t blks_size(const Block *blks, int nblks)
+{
+    size_t size = nblks * (sizeof(Block) + sizeof(Extent));
+    for (int i = 0; i < nblks; ++i)
+        for (TagName name = 0; name < NullTagName; ++name)
+            for (const Tag *tag = blks[i].tags[name]; tag; tag = tag->previous)
+                size += sizeof(Tag);
+    return size;
+}
+
+static inline MemoEntry *entry_evict(BlockType blktype, MemoEntry *entry)
+{
+    LRU_DETACH(memos[blktype].head, entry);
+    memos[blktype].nentries--;
+    memos[blktype].size -= entry->size;
+    blks_free(entry->blks, entry->nblks);
+    return entry;
+}
+
+static inline void entry_free(MemoEntry *entry)
+{
+    free(entry->blks), free(entry->extents), free(entry->line), free(entry);
+}
+
+// NULL, if the line is too big to be memoized (on its own).
+static inline MemoEntry *memo_add(BlockType blktype, const Block *blks,
+                                  int nblks, const char *line, uint64_t h)
+{
+    MemoEntry *entry = NULL;
+    size_t len = strlen(line),
+           size = sizeof(MemoEntry) + len + 1 + blks_size(blks, nblks);
+    if (size > MEMO_BUDGET)
+        return NULL;
+    // least recently used ones are at the end, evicted ones are recycled
+    // (along with their buffers), so that a full memo doesn't allocate.
+    while (memos[blktype].head &&
+           (memos[blktype].nentries == MAX_MEMO_ENTRIES ||
+            memos[blktype].size + size > MEMO_BUDGET)) {
+        MemoEntry *last = memos[blktype].head;
+        while (last->next)
+            last = last->next;
+        entry_evict(blktype, last)->next = memos[blktype].spare;
+        memos[blktype].spare             = last;
+    }
+
+    if ((entry = memos[blktype].spare))
+        memos[blktype].spare = entry->next;
+    else if (!(entry = (MemoEntry *)calloc(1, sizeof(MemoEntry))))
+        return NULL;
+    if (len + 1 > entry->line_capacity) {
+        free(entry->line);
+        entry->line          = (char *)malloc(len + 1);
+        entry->line_capacity = entry->line ? len + 1 : 0;
+    }
+    if (!entry->blks || nblks > entry->blks_capacity) {
+        int capacity = nblks ? nblks : 1;
+        free(entry->blks), free(entry->extents);
+        entry->blks    = (Block *)malloc(capacity * sizeof(Block));
+        entry->extents = (Extent *)malloc((capacity + 1) * sizeof(Extent));
+        entry->blks_capacity = entry->blks && entry->extents ? capacity : 0;
+    }
+    // not memoized, if it doesn't fit (in memory).
+    if (!entry->line_capacity || !entry->blks_capacity) {
+        entry_free(entry);
+        return NULL;
+    }
+    memset(entry->extents, 0, (nblks + 1) * sizeof(Extent));
+    memcpy(entry->line, line, len + 1);
+    entry->hash     = h;
+    entry->nblks    = nblks;
+    entry->width    = 0;
+    entry->measured = false;
+    entry->size     = size;
+    for (int i = 0; i < nblks; ++i)
+        blk_copy(&entry->blks[i], &blks[i]);
+    LRU_ATTACH(memos[blktype].head, entry);
+    memos[blktype].nentries++;
+    memos[blktype].size += size;
+    return entry;
+}
+
+// Same as 'blks_create', for the lines of channel 'blktype', 'memo' being the
+// entry the blocks came from (NULL, if the line couldn't be memoized).
+int memo_blks(BlockType blktype, Block *blks, const char *line,
+              MemoEntry **memo)
+{
+    uint64_t h       = hash(line);
+    MemoEntry *entry = memos[blktype].head;
+    while (entry && (entry->hash != h || strcmp(entry->line, line) != 0))
+        entry = entry->next;
+
+    if (entry) {
+        stats_count(StatMemoHit);
+        LRU_DETACH(memos[blktype].head, entry);
+        LRU_ATTACH(memos[blktype].head, entry);
+        for (int i = 0; i < entry->nblks; ++i)
+            blk_copy(&blks[i], &entry->blks[i]);
+        *memo = entry;
+        return entry->nblks;
+    }
+    stats_count(StatMemoMiss);
+    int nblks = blks_create(blks, MAX_BLKS, line);
+    *memo     = memo_add(blktype, blks, nblks, line, h);
+    return nblks;
+}
+
+// e.g. on config reloads, as the styles (and fonts) might have changed.
+void memo_clear(void)
+{
+    for (BlockType blktype = 0; blktype < MAX_CHANNELS; ++blktype) {
+        while (memos[blktype].head)
+            entry_free(entry_evict(blktype, memos[blktype].head));
+        for (MemoEntry *next; memos[blktype].spare;
+             memos[blktype].spare = next) {
+            next = memos[blktype].spare->next;
+            entry_free(memos[blktype].spare);
+        }
+    }
+}
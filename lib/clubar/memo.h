@@ -0,0 +1,40 @@
+/* Inputs tend to cycle through a few states (focused workspace, layout symbol,
+ * mute/unmute etc), so the recently seen lines of a channel are memoized, to
+ * their parsed blocks and their layout (measured by the frontend):
+ *
+ *   line (hash) => { blocks, extents of the blocks, width of the channel }
+ *
+ * A recurring line is copied back from the memo (instead of being parsed),
+ * and its layout is reused as is (instead of being measured). Memos are LRU
+ * ordered, and bounded per channel (both in entries and in bytes).
+ */
+#ifndef __CLUBAR__MEMO_H__
+#define __CLUBAR__MEMO_H__
+
+#include <clubar.h>
+
+#define MAX_MEMO_ENTRIES (1 << 4)
+#define MEMO_BUDGET      (1 << 18) // bytes, per channel.
+
+// position (relative to the start of the channel) and width of a block.
+typedef struct Extent {
+    int x, width;
+} Extent;
+
+typedef struct MemoEntry {
+    uint64_t hash;
+    char *line;
+    size_t line_capacity;
+    Block *blks;
+    int nblks, blks_capacity; // of 'blks' (and 'extents', plus one).
+    Extent *extents;
+    int width;     // of the channel.
+    bool measured; // 'extents' and 'width' are set (by the frontend).
+    size_t size;
+    struct MemoEntry *prev, *next;
+} MemoEntry;
+
+int memo_blks(BlockType, Block *, const char *, MemoEntry **);
+void memo_clear(void);
+
+#endif
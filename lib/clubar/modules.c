@@ -0,0 +1,322 @@
+#include "modules.h"
+#include "sched.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MODULE_TEXT_SIZE BLK_BUFFER_SIZE
+
+typedef struct Module Module;
+typedef bool (*ModuleReader)(Module *, char *, size_t);
+
+typedef struct ModuleDef {
+    const char *name;
+    double interval;
+    const char *format, *path;
+    ModuleReader read;
+} ModuleDef;
+
+struct Module {
+    const ModuleDef *def;
+    ModuleSpec spec;
+    int fds[2];
+    uint64_t prev[3]; // reader specific state (previous sample).
+    char text[MODULE_TEXT_SIZE];
+};
+
+static Module modules[MAX_MODULES];
+static int nmodules        = 0;
+static Publisher publisher = NULL;
+// modules are updated by the scheduler, and by the frontend ('modules_set').
+static pthread_mutex_t modules_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool read_fd(int fd, char *buffer, size_t size)
+{
+    ssize_t n = pread(fd, buffer, size - 1, 0);
+    buffer[n > 0 ? n : 0] = 0;
+    return n > 0;
+}
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void human_size(double bytes, char *buffer, size_t size)
+{
+    static const char units[] = "BKMGT";
+    int u = 0;
+    for (; bytes >= 1024 && units[u + 1]; ++u)
+        bytes /= 1024;
+    snprintf(buffer, size, u ? "%.1f%c" : "%.0f%c", bytes, units[u]);
+}
+
+static bool read_clock(Module *m, char *value, size_t size)
+{
+    time_t now = time(NULL);
+    struct tm tm;
+    return strftime(value, size, m->spec.format, localtime_r(&now, &tm)) > 0;
+}
+
+static bool read_cpu(Module *m, char *value, size_t size)
+{
+    char buffer[1 << 8];
+    uint64_t v[8] = {0}, total = 0, idle;
+    if (!read_fd(m->fds[0], buffer, sizeof(buffer)) ||
+        sscanf(buffer, "cpu %lu %lu %lu %lu %lu %lu %lu %lu", &v[0], &v[1],
+               &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4)
+        return false;
+    for (int i = 0; i < 8; ++i)
+        total += v[i];
+    idle = v[3] + v[4]; // idle + iowait.
+
+    uint64_t dtotal = total - m->prev[0], didle = idle - m->prev[1];
+    m->prev[0] = total, m->prev[1] = idle;
+    snprintf(value, size, "%d%%",
+             dtotal ? (int)(100 * (dtotal - didle) / dtotal) : 0);
+    return true;
+}
+
+static bool read_memory(Module *m, char *value, size_t size)
+{
+    char buffer[1 << 11], *field;
+    unsigned long total = 0, available = 0;
+    if (!read_fd(m->fds[0], buffer, sizeof(buffer)))
+        return false;
+    if ((field = strstr(buffer, "MemTotal:")))
+        sscanf(field, "MemTotal: %lu", &total);
+    if ((field = strstr(buffer, "MemAvailable:")))
+        sscanf(field, "MemAvailable: %lu", &available);
+    if (!total)
+        return false;
+    snprintf(value, size, "%d%%", (int)(100 * (total - available) / total));
+    return true;
+}
+
+static bool read_battery(Module *m, char *value, size_t size)
+{
+    char capacity[16], status[32];
+    if (!read_fd(m->fds[0], capacity, sizeof(capacity)))
+        return false;
+    read_fd(m->fds[1], status, sizeof(status));
+    snprintf(value, size, "%s%d%%",
+             strncmp(status, "Charging", 8) == 0 ? "+" : "", atoi(capacity));
+    return true;
+}
+
+static bool read_network(Module *m, char *value, size_t size)
+{
+    char buffer[1 << 12], iface[32], rx_str[16], tx_str[16];
+    unsigned long rx, tx, rx_total = 0, tx_total = 0;
+    if (!read_fd(m->fds[0], buffer, sizeof(buffer)))
+        return false;
+
+    // skipping the 2 header lines.
+    char *line = strchr(buffer, '\n');
+    line       = line ? strchr(line + 1, '\n') : NULL;
+    for (; line && *++line; line = strchr(line, '\n')) {
+        if (sscanf(line, " %31[^:]: %lu %*u %*u %*u %*u %*u %*u %*u %lu", iface,
+                   &rx, &tx) == 3 &&
+            strcmp(iface, "lo") != 0)
+            rx_total += rx, tx_total += tx;
+        if (!strchr(line, '\n'))
+            break;
+    }
+
+    uint64_t now = now_ns();
+    double elapsed = m->prev[2] ? (now - m->prev[2]) / 1e9 : 0;
+    human_size(elapsed ? (rx_total - m->prev[0]) / elapsed : 0, rx_str,
+               sizeof(rx_str));
+    human_size(elapsed ? (tx_total - m->prev[1]) / elapsed : 0, tx_str,
+               sizeof(tx_str));
+    m->prev[0] = rx_total, m->prev[1] = tx_total, m->prev[2] = now;
+    snprintf(value, size, "%s/s %s/s", rx_str, tx_str);
+    return true;
+}
+
+static const ModuleDef ModuleDefs[] = {
+    {"clock", 1, " %a %d %b %H:%M:%S ", NULL, read_clock},
+    {"cpu", 2, " CPU %s ", "/proc/stat", read_cpu},
+    {"memory", 5, " MEM %s ", "/proc/meminfo", read_memory},
+    {"battery", 30, " BAT %s ", "/sys/class/power_supply", read_battery},
+    {"network", 2, " NET %s ", "/proc/net/dev", read_network},
+    // fed by the frontend (no reader), e.g. from X events.
+    {"workspaces", 0, "%s", NULL, NULL},
+    {"window", 0, " %s ", NULL, NULL},
+};
+
+static inline bool open_battery(Module *m)
+{
+    char path[1 << 9], type[16];
+    DIR *dir = opendir(m->def->path);
+    if (!dir)
+        return false;
+    for (struct dirent *e; m->fds[0] < 0 && (e = readdir(dir));) {
+        if (e->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s/type", m->def->path, e->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        bool battery = read_fd(fd, type, sizeof(type)) &&
+                       strncmp(type, "Battery", 7) == 0;
+        close(fd);
+        if (!battery)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s/capacity", m->def->path,
+                 e->d_name);
+        m->fds[0] = open(path, O_RDONLY | O_CLOEXEC);
+        snprintf(path, sizeof(path), "%s/%s/status", m->def->path,
+                 e->d_name);
+        m->fds[1] = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    closedir(dir);
+    return m->fds[0] >= 0;
+}
+
+static inline bool module_open(Module *m)
+{
+    m->fds[0] = m->fds[1] = -1;
+    if (!m->def->path)
+        return true;
+    if (m->def->read == read_battery)
+        return open_battery(m);
+    return (m->fds[0] = open(m->def->path, O_RDONLY | O_CLOEXEC)) >= 0;
+}
+
+// expands every '%s' (in 'format') with 'value' ('%%' => '%').
+static inline void expand(const char *format, const char *value, char *buffer,
+                          size_t size)
+{
+    size_t n = 0;
+    for (const char *c = format; *c && n < size - 1; ++c) {
+        if (c[0] == '%' && c[1] == 's') {
+            n += snprintf(buffer + n, size - n, "%s", value), ++c;
+            n = n < size ? n : size - 1;
+        } else if (c[0] == '%' && c[1] == '%') {
+            buffer[n++] = '%', ++c;
+        } else {
+            buffer[n++] = *c;
+        }
+    }
+    buffer[n] = 0;
+}
+
+// only republishes the region, if the module's output actually changed.
+static inline void module_publish(Module *m, const char *text)
+{
+    static char line[BLK_BUFFER_SIZE];
+    pthread_mutex_lock(&modules_mutex);
+    if (strcmp(text, m->text) != 0) {
+        strcpy(m->text, text);
+        memset(line, 0, sizeof(line));
+        for (int i = 0, n = 0; i < nmodules; ++i) {
+            int len = strlen(modules[i].text);
+            if (n + len >= BLK_BUFFER_SIZE)
+                break;
+            memcpy(line + n, modules[i].text, len), n += len;
+        }
+        publisher(Modules, line);
+    }
+    pthread_mutex_unlock(&modules_mutex);
+}
+
+static void module_tick(void *ctx)
+{
+    Module *m = (Module *)ctx;
+    char value[MODULE_TEXT_SIZE], text[MODULE_TEXT_SIZE];
+    if (!m->def->read(m, value, sizeof(value)))
+        return;
+    if (m->def->read == read_clock)
+        strcpy(text, value);
+    else
+        expand(m->spec.format, value, text, sizeof(text));
+    module_publish(m, text);
+}
+
+// value of a module without a reader (i.e. fed by the frontend), returns
+// whether the module is enabled.
+bool modules_set(const char *name, const char *value)
+{
+    char text[MODULE_TEXT_SIZE];
+    bool enabled = false;
+    for (int i = 0; i < nmodules; ++i) {
+        if (modules[i].def->read || strcmp(modules[i].def->name, name) != 0)
+            continue;
+        expand(modules[i].spec.format, value, text, sizeof(text));
+        module_publish(&modules[i], text);
+        enabled = true;
+    }
+    return enabled;
+}
+
+// format: 'name[:interval[:format]]' (e.g. 'cpu:2:<Fg=#8f8>CPU</Fg> %s').
+bool load_module_from_string(const char *str, Config *c)
+{
+    ModuleSpec spec = {0};
+    int cursor      = 0;
+
+    if (sscanf(str, "%15[^:]%n", spec.name, &cursor) != 1)
+        return false;
+    if (str[cursor] == ':' && str[++cursor] != ':') {
+        int n = 0;
+        if (sscanf(str + cursor, "%lf%n", &spec.interval, &n) != 1 ||
+            spec.interval <= 0)
+            return false;
+        cursor += n;
+    }
+    if (str[cursor] == ':')
+        snprintf(spec.format, sizeof(spec.format), "%s", str + cursor + 1);
+    else if (str[cursor])
+        return false;
+
+    // merged by name (as styles are), e.g. a config reload replaces a module.
+    int i = 0;
+    while (i < c->nmodules && strcmp(c->modules[i].name, spec.name) != 0)
+        ++i;
+    if (i == MAX_MODULES)
+        return false;
+    c->nmodules   = i == c->nmodules ? i + 1 : c->nmodules;
+    c->modules[i] = spec;
+    return true;
+}
+
+void modules_init(const Config *config, Publisher publish)
+{
+    publisher = publish;
+    for (int i = 0; i < config->nmodules; ++i) {
+        Module *m = &modules[nmodules];
+        memset(m, 0, sizeof(*m));
+        m->spec = config->modules[i];
+        for (size_t d = 0; d < sizeof(ModuleDefs) / sizeof(*ModuleDefs); ++d)
+            if (strcmp(ModuleDefs[d].name, m->spec.name) == 0)
+                m->def = &ModuleDefs[d];
+        if (!m->def) {
+            eprintf("Unknown module: '%s'.\n", m->spec.name);
+            continue;
+        }
+        if (m->spec.interval <= 0)
+            m->spec.interval = m->def->interval;
+        if (!strlen(m->spec.format))
+            strcpy(m->spec.format, m->def->format);
+        if (!module_open(m)) {
+            eprintf("Unable to initialize module: '%s'.\n", m->spec.name);
+            continue;
+        }
+        if (!m->def->read) {
+            nmodules++;
+            continue;
+        }
+        if (!sched_every(m->spec.interval, module_tick, m)) {
+            eprintf("Unable to schedule module: '%s'.\n", m->spec.name);
+            continue;
+        }
+        nmodules++;
+    }
+}
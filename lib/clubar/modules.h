@@ -0,0 +1,25 @@
+/* Native status modules, reading '/proc' and '/sys' directly (no fork/exec),
+ * each module is rendered using its (markup) format string and the output of
+ * all the modules is published to the 'Modules' region.
+ * Modules without an interval are fed by the frontend (with 'modules_set'),
+ * only when what they show changes.
+ *
+ * Modules (default interval, format):
+ *   clock   (1s, " %a %d %b %H:%M:%S ")  format is passed to 'strftime'.
+ *   cpu     (2s, " CPU %s ")             '%s' => usage percentage.
+ *   memory  (5s, " MEM %s ")             '%s' => used memory percentage.
+ *   battery (30s, " BAT %s ")            '%s' => capacity ('+' charging).
+ *   network (2s, " NET %s ")             '%s' => rx/tx rates.
+ *   workspaces (-, "%s")                 '%s' => (EWMH) desktops, clickable.
+ *   window  (-, " %s ")                  '%s' => title of the active window.
+ */
+#ifndef __CLUBAR__MODULES_H__
+#define __CLUBAR__MODULES_H__
+
+#include <clubar.h>
+
+bool load_module_from_string(const char *, Config *);
+void modules_init(const Config *, Publisher);
+bool modules_set(const char *, const char *);
+
+#endif
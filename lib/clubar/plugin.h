@@ -0,0 +1,58 @@
+/* ABI for runtime loaded (native) producer plugins.
+ * This header is self-contained, so that plugins can simply copy it into their
+ * source tree. A plugin is a shared object (in the plugin directory, see
+ * '--plugins'), exporting 'clubar_plugin_init' (and optionally
+ * 'clubar_plugin_exit'):
+ *
+ *   static const ClubarHost *host;
+ *   static int channel;
+ *   static void tick(void *ctx)
+ *   {
+ *       static char line[64];
+ *       snprintf(line, sizeof(line), "<Fg=#8f8>GPU</Fg> %d", read_temp());
+ *       host->publish_segment(channel, "gpu", line);
+ *   }
+ *   int clubar_plugin_init(const ClubarHost *h)
+ *   {
+ *       host = h, channel = h->channel("ipc");
+ *       return channel < 0 || !h->every(2, tick, NULL);
+ *   }
+ *
+ *   $ cc -shared -fPIC -o ~/.config/clubar/plugins/gpu.so gpu.c
+ *
+ * The host only ever appends members to 'ClubarHost' (bumping
+ * 'CLUBAR_PLUGIN_ABI'), so a plugin built against an older header keeps
+ * working. Callbacks run on clubar's scheduler thread, and the registration
+ * functions are only to be called from 'clubar_plugin_init' or from within
+ * the callbacks. Lines are copied (parsed) before 'publish' returns.
+ */
+#ifndef __CLUBAR__PLUGIN_H__
+#define __CLUBAR__PLUGIN_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CLUBAR_PLUGIN_ABI  1
+#define CLUBAR_PLUGIN_INIT "clubar_plugin_init"
+#define CLUBAR_PLUGIN_EXIT "clubar_plugin_exit"
+
+typedef struct ClubarHost {
+    uint32_t abi, size; // 'CLUBAR_PLUGIN_ABI' and 'sizeof(ClubarHost)'.
+    // index of a channel (by name), -1 if there isn't one.
+    int (*channel)(const char *);
+    // (markup) line of a channel, or of a named segment of the channel (a NULL
+    // line removes the segment).
+    bool (*publish)(int, const char *);
+    bool (*publish_segment)(int, const char *, const char *);
+    // calls back every N seconds (first one right away), or whenever the fd
+    // is readable.
+    bool (*every)(double, void (*)(void *), void *);
+    bool (*watch)(int, void (*)(void *), void *);
+    void (*unwatch)(int);
+} ClubarHost;
+
+// returns 0 on success (nothing is to be registered otherwise).
+typedef int (*ClubarPluginInit)(const ClubarHost *);
+typedef void (*ClubarPluginExit)(void);
+
+#endif
@@ -1,12 +1,47 @@
 /* Enable Plugin with: `make PLUGINS=luaconfig`
  * This plugin enables runtime configuration support using lua source code.
  * check 'examples' directory for sample configs.
+ *
+ * The lua state is kept around, so that functions registered with
+ * 'clubar.every' can produce segments (in-process), eg:
+ *   clubar.every(1, function() return os.date("%H:%M:%S") end)
  */
 #include "luaconfig.h"
+#include <clubar/modules.h>
+#include <clubar/sched.h>
 #include <lauxlib.h>
 #include <lualib.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define MAX_PRODUCERS (1 << 4)
+
+// function registered with 'clubar.every(interval, function [, channel])',
+// whatever it returns is set as a segment of 'channel' (default: 'ipc'),
+// 'nil' removes the segment.
+typedef struct Producer {
+    int ref, timerfd;
+    double interval;
+    BlockType blktype;
+    char segment[16];
+} Producer;
+
+// the lua state lives as long as the process does, it's used by the scheduler
+// thread (producers) and reloads (signal thread) alike.
+static lua_State *L               = NULL;
+static pthread_mutex_t lua_mutex  = PTHREAD_MUTEX_INITIALIZER;
+static Producer producers[MAX_PRODUCERS];
+static int nproducers             = 0;
+static bool started               = false;
+static const Config *current      = NULL;
+static SegmentPublisher publisher = NULL;
+// segments of the producers gone with a reload, removed from the scheduler
+// thread (as reloads take the locks the publisher needs).
+static Producer stale[MAX_PRODUCERS];
+static int nstale = 0, stale_timerfd = -1;
 
 #define GetField(L, index, field, result, lua_f)                               \
     {                                                                          \
@@ -39,7 +74,6 @@ static inline void GetString(lua_State *L, int index, const char *f, char *res)
 
 static inline void load_fonts(lua_State *L, Config *c)
 {
-    c->nfonts = 0;
     lua_getfield(L, 1, "fonts");
     if (lua_isnil(L, 2))
         return;
@@ -52,23 +86,216 @@ static inline void load_fonts(lua_State *L, Config *c)
     while (lua_next(L, -2)) {
         lua_pushvalue(L, -2);
         c->fonts = realloc(c->fonts, (c->nfonts + 1) * sizeof(char *));
-        c->fonts[c->nfonts++] = (char *)lua_tostring(L, -2);
+        // copied, the strings are only valid while they are on the stack.
+        c->fonts[c->nfonts++] = strdup(lua_tostring(L, -2));
         lua_pop(L, 2);
     }
 }
 
+static inline void load_modules(lua_State *L, Config *c)
+{
+    lua_getfield(L, 1, "modules");
+    if (lua_istable(L, -1)) {
+        // modules are drawn in order, hence not using 'lua_next'.
+        for (int i = 1; lua_rawgeti(L, -1, i), !lua_isnil(L, -1); ++i) {
+            if (!lua_isstring(L, -1) ||
+                !load_module_from_string(lua_tostring(L, -1), c))
+                eprintf("Invalid module at index: %d.\n", i);
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+// 'styles' is a table of name = markup (e.g. warn = '<Fg=#f00><Bg=#222>').
+static inline void load_styles(lua_State *L, Config *c)
+{
+    char style[sizeof(c->styles->name) + sizeof(c->styles->markup)];
+    lua_getfield(L, 1, "styles");
+    if (lua_istable(L, -1)) {
+        for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) {
+            if (lua_type(L, -2) != LUA_TSTRING || !lua_isstring(L, -1))
+                continue;
+            snprintf(style, sizeof(style), "%s:%s", lua_tostring(L, -2),
+                     lua_tostring(L, -1));
+            if (!load_style_from_string(style, c))
+                eprintf("Invalid style: '%s'.\n", lua_tostring(L, -2));
+        }
+    }
+    lua_pop(L, 1);
+}
+
+// (re)arms the timers of the registered producers, and disarms the rest.
+static inline void arm_producers(void)
+{
+    for (int i = 0; i < MAX_PRODUCERS; ++i) {
+        uint64_t interval = i < nproducers ? producers[i].interval * 1e9 : 0;
+        struct itimerspec its = {
+            .it_interval = {interval / 1000000000ull, interval % 1000000000ull},
+            .it_value    = {0, interval ? 1 : 0}, // first run, right away.
+        };
+        timerfd_settime(producers[i].timerfd, 0, &its, NULL);
+    }
+}
+
+static inline bool is_registered(const Producer *p)
+{
+    for (int i = 0; i < nproducers; ++i)
+        if (producers[i].blktype == p->blktype &&
+            strcmp(producers[i].segment, p->segment) == 0)
+            return true;
+    return false;
+}
+
+// the previous producers that weren't registered again, are removed.
+static inline void drop_stale(const Producer *previous, int nprevious)
+{
+    struct itimerspec its = {.it_value = {0, 1}}; // right away, once.
+    for (int i = 0; i < nprevious && nstale < MAX_PRODUCERS; ++i)
+        if (!is_registered(&previous[i]))
+            stale[nstale++] = previous[i];
+    if (nstale)
+        timerfd_settime(stale_timerfd, 0, &its, NULL);
+}
+
+static void remove_stale(void *ctx)
+{
+    (void)ctx;
+    uint64_t expirations;
+    Producer removed[MAX_PRODUCERS];
+    int nremoved = 0;
+    if (read(stale_timerfd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    pthread_mutex_lock(&lua_mutex);
+    // unless registered again since (by yet another reload).
+    for (int i = 0; i < nstale; ++i)
+        if (!is_registered(&stale[i]))
+            removed[nremoved++] = stale[i];
+    nstale = 0;
+    pthread_mutex_unlock(&lua_mutex);
+
+    for (int i = 0; i < nremoved; ++i)
+        publisher(removed[i].blktype, removed[i].segment, NULL);
+}
+
+static void run_producer(void *ctx)
+{
+    Producer *producer = (Producer *)ctx;
+    uint64_t expirations;
+    char line[BLK_BUFFER_SIZE];
+    bool publish = false, remove = false;
+    if (read(producer->timerfd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    pthread_mutex_lock(&lua_mutex);
+    // might have been unregistered by a reload (timer already expired).
+    if (producer - producers < nproducers) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, producer->ref);
+        if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
+            eprintf("Producer '%s' failed: %s.\n", producer->segment,
+                    lua_tostring(L, -1));
+        } else if ((remove = lua_isnil(L, -1)) || lua_isstring(L, -1)) {
+            publish = true;
+            snprintf(line, sizeof(line), "%s",
+                     remove ? "" : lua_tostring(L, -1));
+        }
+        lua_pop(L, 1);
+    }
+    pthread_mutex_unlock(&lua_mutex);
+
+    // published without holding the lock, as reloads take the locks (the
+    // publisher needs) before this one.
+    if (publish)
+        publisher(producer->blktype, producer->segment, remove ? NULL : line);
+}
+
+static int lua_every(lua_State *L)
+{
+    double interval     = luaL_checknumber(L, 1);
+    const char *channel = luaL_optstring(L, 3, "ipc");
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    if (interval <= 0)
+        return luaL_error(L, "interval must be positive");
+    if (nproducers == MAX_PRODUCERS)
+        return luaL_error(L, "too many producers (max: %d)", MAX_PRODUCERS);
+
+    Producer *producer = &producers[nproducers];
+    producer->blktype  = -1;
+    for (BlockType b = 0; b < current->nchannels; ++b)
+        if (strcmp(current->channels[b].name, channel) == 0)
+            producer->blktype = b;
+    if (producer->blktype < 0)
+        return luaL_error(L, "no channel named '%s'", channel);
+
+    lua_pushvalue(L, 2);
+    producer->ref      = luaL_ref(L, LUA_REGISTRYINDEX);
+    producer->interval = interval;
+    snprintf(producer->segment, sizeof(producer->segment), "lua%d",
+             nproducers++);
+    return 0;
+}
+
+void luaconfig_start(SegmentPublisher publish)
+{
+    pthread_mutex_lock(&lua_mutex);
+    publisher = publish;
+    for (int i = 0; i < MAX_PRODUCERS; ++i) {
+        producers[i].timerfd =
+            timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (producers[i].timerfd < 0 ||
+            !sched_watch(producers[i].timerfd, run_producer, &producers[i]))
+            die("Unable to create timers for lua producers.\n");
+    }
+    stale_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (stale_timerfd < 0 || !sched_watch(stale_timerfd, remove_stale, NULL))
+        die("Unable to create timers for lua producers.\n");
+    started = true;
+    arm_producers();
+    pthread_mutex_unlock(&lua_mutex);
+}
+
 void luaconfig_merge(const char *luafile, Config *config)
 {
     if (!luafile || !strlen(luafile))
         return;
-    lua_State *L = luaL_newstate();
-    luaL_openlibs(L);
-    if (luaL_dofile(L, luafile))
-        die("Unable to load lua file: '%s'.\n", luafile);
+    pthread_mutex_lock(&lua_mutex);
+    if (!L) {
+        L = luaL_newstate();
+        luaL_openlibs(L);
+        lua_newtable(L);
+        lua_pushcfunction(L, lua_every);
+        lua_setfield(L, -2, "every");
+        lua_setglobal(L, "clubar");
+    }
+    // producers are registered all over again, on every (re)load, the previous
+    // ones are kept until the file is known to be valid.
+    Producer previous[MAX_PRODUCERS];
+    int nprevious = nproducers;
+    memcpy(previous, producers, sizeof(producers));
+    nproducers = 0, current = config;
 
-    lua_getglobal(L, "Config");
-    if (lua_isnil(L, 1))
-        die("Invalid 'Config' table.\n");
+    bool valid = luaL_dofile(L, luafile) == LUA_OK;
+    if (!valid) {
+        eprintf("Unable to load lua file: %s.\n", lua_tostring(L, -1));
+    } else if (lua_settop(L, 0), lua_getglobal(L, "Config"),
+               !(valid = lua_istable(L, 1))) {
+        eprintf("Invalid 'Config' table.\n");
+    }
+
+    if (!valid) {
+        // e.g. a half edited file (auto reload), the config is left as it was.
+        for (int i = 0; i < nproducers; ++i)
+            luaL_unref(L, LUA_REGISTRYINDEX, producers[i].ref);
+        memcpy(producers, previous, sizeof(producers));
+        nproducers = nprevious;
+        lua_settop(L, 0);
+        pthread_mutex_unlock(&lua_mutex);
+        return;
+    }
+    for (int i = 0; i < nprevious; ++i)
+        luaL_unref(L, LUA_REGISTRYINDEX, previous[i].ref);
 
     int ret[4];
     const char *g_members[] = {"x", "y", "w", "h"};
@@ -91,5 +318,20 @@ void luaconfig_merge(const char *luafile, Config *config)
     GetString(L, 1, "border", (char *)border);
     config->border_width = parse_color_string(border, config->border_color);
 
+    lua_getfield(L, 1, "plugins");
+    if (lua_isstring(L, -1))
+        snprintf(config->plugin_dir, sizeof(config->plugin_dir), "%s",
+                 lua_tostring(L, -1));
+    lua_pop(L, 1);
+
+    load_modules(L, config);
+    load_styles(L, config);
     load_fonts(L, config);
+
+    lua_settop(L, 0);
+    if (started) {
+        drop_stale(previous, nprevious);
+        arm_producers();
+    }
+    pthread_mutex_unlock(&lua_mutex);
 }
@@ -1,3 +1,4 @@
 #include <clubar.h>
 
 void luaconfig_merge(const char *, Config *);
+void luaconfig_start(SegmentPublisher);
@@ -1,26 +1,118 @@
 /* Enable Plugin with: `make PLUGINS=xrmconfig`
  * This plugin enables runtime configuration support using X Resources.
  * check 'examples' directory for sample configs.
+ *
+ * With the frontend's display connection ('xrmconfig_init'), the resources
+ * are (re)read by the frontend's thread, on 'RESOURCE_MANAGER' changes (e.g.
+ * 'xrdb -merge'), and only the resources that might concern clubar (its own,
+ * and loose ones like '*background') are kept around, merging the config
+ * doesn't make any requests to the X server.
  */
 #include "xrmconfig.h"
-#include <X11/Xlib.h>
+#include <X11/Xatom.h>
 #include <X11/Xresource.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define MAX_RESOURCES_SIZE (1 << 14)
+
+static pthread_mutex_t xrm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Display *display          = NULL;
+// lines of 'RESOURCE_MANAGER' that concern clubar (see 'is_clubar_resource').
+static char resources[MAX_RESOURCES_SIZE];
+
+// clubar's own lines, and the loose ones (e.g. '*background', '?.font') that
+// clubar's resources might match as well.
+static inline bool is_clubar_resource(const char *line, size_t nline)
+{
+    size_t len = strlen(NAME);
+    while (nline && (*line == ' ' || *line == '\t'))
+        line++, nline--;
+    if (nline && (*line == '*' || *line == '?'))
+        return true;
+    return nline > len && strncmp(line, NAME, len) == 0 &&
+           (line[len] == '.' || line[len] == '*');
+}
+
+static inline void filter_resources(const char *all, char *out)
+{
+    size_t n = 0, nline;
+    for (const char *line = all, *end; line && *line;
+         line = end ? end + 1 : NULL) {
+        nline = (end = strchr(line, '\n')) ? (size_t)(end - line)
+                                           : strlen(line);
+        if (is_clubar_resource(line, nline) &&
+            n + nline + 1 < MAX_RESOURCES_SIZE) {
+            memcpy(out + n, line, nline);
+            n += nline, out[n++] = '\n';
+        }
+    }
+    out[n] = 0;
+}
+
+// 'XResourceManagerString' is only read once (on connect), hence the property.
+static inline void fetch_resources(Display *dpy, char *out)
+{
+    Atom type;
+    int format;
+    unsigned long nitems, remaining;
+    unsigned char *data = NULL;
+    out[0]              = 0;
+    if (XGetWindowProperty(dpy, DefaultRootWindow(dpy), XA_RESOURCE_MANAGER, 0,
+                           MAX_RESOURCES_SIZE << 4, False, XA_STRING, &type,
+                           &format, &nitems, &remaining, &data) == Success &&
+        data)
+        filter_resources((char *)data, out);
+    if (data)
+        XFree(data);
+}
+
+void xrmconfig_init(Display *dpy)
+{
+    char fresh[MAX_RESOURCES_SIZE];
+    fetch_resources(dpy, fresh);
+    pthread_mutex_lock(&xrm_mutex);
+    display = dpy;
+    strcpy(resources, fresh);
+    pthread_mutex_unlock(&xrm_mutex);
+}
+
+// To be called on 'RESOURCE_MANAGER' changes (by the thread that owns the
+// display), returns whether clubar's resources changed.
+bool xrmconfig_update(void)
+{
+    char fresh[MAX_RESOURCES_SIZE];
+    bool changed;
+    if (!display)
+        return false;
+    fetch_resources(display, fresh);
+    pthread_mutex_lock(&xrm_mutex);
+    if ((changed = strcmp(resources, fresh) != 0))
+        strcpy(resources, fresh);
+    pthread_mutex_unlock(&xrm_mutex);
+    return changed;
+}
+
 void xrmconfig_merge(Config *config)
 {
     char *value;
     XrmValue xrm_value;
+    XrmDatabase db;
 
-    Display *dpy;
-    if (!(dpy = XOpenDisplay(NULL)))
-        die("unable to open display.\n");
-
+    pthread_mutex_lock(&xrm_mutex);
+    // without the frontend's connection, it's a connection per merge.
+    if (!display) {
+        Display *dpy;
+        if (!(dpy = XOpenDisplay(NULL)))
+            die("unable to open display.\n");
+        fetch_resources(dpy, resources);
+        XCloseDisplay(dpy);
+    }
     XrmInitialize();
-    const char *resm = XResourceManagerString(dpy);
-    XrmDatabase db   = XrmGetStringDatabase(resm);
+    db = XrmGetStringDatabase(resources);
+    pthread_mutex_unlock(&xrm_mutex);
 
     if (XrmGetResource(db, NAME ".fonts", "*", &value, &xrm_value) &&
         xrm_value.size > 0)
@@ -57,11 +149,29 @@ void xrmconfig_merge(Config *config)
     if (XrmGetResource(db, NAME ".background", "*", &value, &xrm_value))
         memcpy(config->background, xrm_value.addr, xrm_value.size);
 
+    if (XrmGetResource(db, NAME ".plugins", "*", &value, &xrm_value))
+        snprintf(config->plugin_dir, sizeof(config->plugin_dir), "%.*s",
+                 (int)xrm_value.size, xrm_value.addr);
+
     char border[32] = {0};
     if (XrmGetResource(db, NAME ".border", "*", &value, &xrm_value))
         memcpy(border, xrm_value.addr, xrm_value.size);
     config->border_width = parse_color_string(border, config->border_color);
 
+    // 'name:markup' pairs, separated by ';', merged by name.
+    if (XrmGetResource(db, NAME ".styles", "*", &value, &xrm_value)) {
+        char *save, styles[1 << 12] = {0};
+        memcpy(styles, xrm_value.addr,
+               xrm_value.size < sizeof(styles) ? xrm_value.size
+                                               : sizeof(styles) - 1);
+        for (char *style = strtok_r(styles, ";", &save); style;
+             style       = strtok_r(NULL, ";", &save)) {
+            while (*style == ' ')
+                style++;
+            if (*style && !load_style_from_string(style, config))
+                eprintf("Invalid Xrm config: 'styles' (%s).\n", style);
+        }
+    }
+
     XrmDestroyDatabase(db);
-    XCloseDisplay(dpy);
 }
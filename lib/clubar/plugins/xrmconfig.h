@@ -1,3 +1,6 @@
+#include <X11/Xlib.h>
 #include <clubar.h>
 
+void xrmconfig_init(Display *);
+bool xrmconfig_update(void);
 void xrmconfig_merge(Config *);
@@ -0,0 +1,32 @@
+/* USDT probes (provider 'clubar'), built in with 'make USDT=1' (requires
+ * 'sys/sdt.h', from systemtap). A probe is a single 'nop' until something
+ * attaches to it, and without 'USDT' the probes aren't compiled at all.
+ *
+ *   $ sudo bpftrace -p $(pidof clubar) examples/clubar-latency.bt
+ *
+ * line        (channel, line)      a line was read by the input thread.
+ * wm_name     (name)               WM_NAME of the root window was fetched.
+ * parse_start (line)               'blks_create' started.
+ * parse_end   (nblks)              'blks_create' ended, with the block count.
+ * gis_start   (channel)            measuring the blocks of a channel started.
+ * gis_end     (channel, width)     measuring ended, with the channel width.
+ * draw_start  (channel)            'gui_draw' started.
+ * draw_end    (channel)            'gui_draw' ended.
+ * color_miss  (name)               a color wasn't cached (allocated on server).
+ * exec        (command, count)     an action is being spawned.
+ */
+#ifndef __CLUBAR__PROBES_H__
+#define __CLUBAR__PROBES_H__
+
+#ifdef __ENABLE_USDT__
+#include <sys/sdt.h>
+#define PROBE(name)          DTRACE_PROBE(clubar, name)
+#define PROBE1(name, a)      DTRACE_PROBE1(clubar, name, a)
+#define PROBE2(name, a, b)   DTRACE_PROBE2(clubar, name, a, b)
+#else
+#define PROBE(name)          (void)0
+#define PROBE1(name, a)      (void)0
+#define PROBE2(name, a, b)   (void)0
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#include "replay.h"
+#include "stats.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct {
+    FILE *fp;
+    uint64_t start;
+} recorder = {NULL, 0};
+
+bool record_open(const char *filepath)
+{
+    if (!(recorder.fp = fopen(filepath, "w")))
+        return false;
+    // line buffered, so that a crashing session still leaves a usable log.
+    setvbuf(recorder.fp, NULL, _IOLBF, 0);
+    recorder.start = stats_now();
+    return true;
+}
+
+void record_write(const char *channel, const char *line)
+{
+    if (!recorder.fp)
+        return;
+    // lines are written from multiple threads (e.g. the dropped ones, by the
+    // input thread), and shouldn't interleave.
+    flockfile(recorder.fp);
+    fprintf(recorder.fp, "%" PRIu64 " %s ", stats_now() - recorder.start,
+            channel);
+    // a newline would break the format (WM_NAME is free to contain them).
+    for (const char *c = line; *c; ++c)
+        putc_unlocked(*c == '\n' ? ' ' : *c, recorder.fp);
+    putc_unlocked('\n', recorder.fp);
+    funlockfile(recorder.fp);
+}
+
+void record_close(void)
+{
+    if (recorder.fp)
+        fclose(recorder.fp);
+    recorder.fp = NULL;
+}
+
+bool replay_open(Replay *replay, const char *filepath, double speed)
+{
+    if (!(replay->fp = fopen(filepath, "r")))
+        return false;
+    replay->speed = speed;
+    replay->start = stats_now();
+    return true;
+}
+
+static inline void sleep_until(uint64_t ns)
+{
+    struct timespec ts = {.tv_sec = ns / 1000000000ull,
+                          .tv_nsec = ns % 1000000000ull};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+// Reads the next event into 'line' (of 'size' bytes), blocking until the event
+// is due (as per the recorded timestamps scaled by 'speed').
+bool replay_next(Replay *replay, char channel[32], char *line, size_t size)
+{
+    uint64_t ts;
+    int c;
+    if (fscanf(replay->fp, "%" SCNu64 " %31s", &ts, channel) == 2) {
+        if ((c = fgetc(replay->fp)) != ' ' && c != '\n')
+            ungetc(c, replay->fp);
+        if (c == '\n' || !fgets(line, size, replay->fp))
+            line[0] = 0;
+        else if (!strchr(line, '\n')) // truncate lines that are too long.
+            while ((c = fgetc(replay->fp)) != EOF && c != '\n')
+                (void)0;
+        line[strcspn(line, "\n")] = 0;
+        if (replay->speed > 0)
+            sleep_until(replay->start + ts / replay->speed);
+        return true;
+    }
+    return false;
+}
+
+void replay_close(Replay *replay)
+{
+    if (replay->fp)
+        fclose(replay->fp);
+    replay->fp = NULL;
+}
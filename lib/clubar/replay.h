@@ -0,0 +1,26 @@
+/* Recording format, one event per line:
+ *   '<nanoseconds since recording started> <channel name> <line>\n'
+ * e.g.
+ *   0 stdin [1] 2 3 | tall | focused window title
+ *   1000234103 wm_name <Fg=#8f8>CPU</Fg> 12%
+ */
+#ifndef __CLUBAR__REPLAY_H__
+#define __CLUBAR__REPLAY_H__
+
+#include <clubar.h>
+
+typedef struct Replay {
+    FILE *fp;
+    double speed; // 0 => as fast as possible.
+    uint64_t start;
+} Replay;
+
+bool record_open(const char *);
+void record_write(const char *, const char *);
+void record_close(void);
+
+bool replay_open(Replay *, const char *, double);
+bool replay_next(Replay *, char[32], char *, size_t);
+void replay_close(Replay *);
+
+#endif
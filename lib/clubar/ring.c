@@ -0,0 +1,84 @@
+#include "ring.h"
+#include "sched.h"
+#include "stats.h"
+#include <sys/eventfd.h>
+
+typedef struct Ring {
+    char name[32];
+    BlockType blktype;
+    int memfd, eventfd;
+    RingBuf *buf;
+    uint64_t last; // sequence number of the last consumed record.
+} Ring;
+
+static Ring rings[MAX_CHANNELS];
+static int nrings          = 0;
+static Publisher publisher = NULL;
+
+// Only the latest committed record is consumed. The record is copied out of
+// the shared mapping, and only published if the slot's sequence number didn't
+// change meanwhile (i.e. the producer didn't lap the slot mid-copy). A slot
+// that is still being written is left for the next wakeup (every commit
+// signals the eventfd).
+static void ring_consume(void *ctx)
+{
+    Ring *ring = (Ring *)ctx;
+    uint64_t counter, head;
+    char record[RINGBUF_SLOT_SIZE];
+    if (read(ring->eventfd, &counter, sizeof(counter)) < 0)
+        (void)0; // spurious wakeup.
+
+    while ((head = __atomic_load_n(&ring->buf->head, __ATOMIC_ACQUIRE)) !=
+           ring->last) {
+        RingSlot *slot = &ring->buf->slots[head % RINGBUF_SLOTS];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head)
+            return;
+        memcpy(record, slot->data, sizeof(record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != head)
+            continue; // torn, the (new) latest record is tried instead.
+        record[sizeof(record) - 1] = 0;
+        stats_add(StatRingDropped, head - ring->last - 1);
+        ring->last = head;
+        publisher(ring->blktype, record);
+    }
+}
+
+bool ring_create(const char *name, BlockType blktype, Publisher publish)
+{
+    if (nrings == MAX_CHANNELS)
+        return false;
+    Ring *ring = &rings[nrings];
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    ring->blktype = blktype, ring->last = 0, ring->eventfd = -1;
+
+    if ((ring->memfd = memfd_create(name, MFD_CLOEXEC)) < 0)
+        return false;
+    if (ftruncate(ring->memfd, sizeof(RingBuf)) < 0 ||
+        (ring->buf = mmap(NULL, sizeof(RingBuf), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, ring->memfd, 0)) == MAP_FAILED ||
+        (ring->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+        !sched_watch(ring->eventfd, ring_consume, ring)) {
+        if (ring->buf != MAP_FAILED)
+            munmap(ring->buf, sizeof(RingBuf));
+        if (ring->eventfd >= 0)
+            close(ring->eventfd);
+        close(ring->memfd);
+        return false;
+    }
+    ring->buf->magic = RINGBUF_MAGIC;
+    publisher        = publish;
+    nrings++;
+    return true;
+}
+
+bool ring_fds(const char *name, int fds[2])
+{
+    for (int i = 0; i < nrings; ++i) {
+        if (strcmp(rings[i].name, name) == 0) {
+            fds[0] = rings[i].memfd, fds[1] = rings[i].eventfd;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,12 @@
+/* Consumer side of the shared memory ring buffer channels (see 'ringbuf.h').
+ */
+#ifndef __CLUBAR__RING_H__
+#define __CLUBAR__RING_H__
+
+#include <clubar.h>
+#include <clubar/ringbuf.h>
+
+bool ring_create(const char *, BlockType, Publisher);
+bool ring_fds(const char *, int[2]);
+
+#endif
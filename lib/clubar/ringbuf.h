@@ -0,0 +1,128 @@
+/* Shared memory (single producer) ring buffer, for high rate producers.
+ * This header is self-contained (producer side), so that producers can simply
+ * copy it into their source tree.
+ *
+ *   $ clubar --socket /tmp/clubar.sock --channel cpu:right:ring
+ *
+ *   RingProducer p;
+ *   if (ringbuf_connect(&p, "/tmp/clubar.sock", "cpu") == 0)
+ *       for (;; usleep(50000))
+ *           ringbuf_commit(&p, "<Fg=#8f8>CPU</Fg> 42%");
+ *
+ * Every commit goes into the next slot (guarded by a per slot sequence
+ * number), and only the latest committed record is consumed (copied out of the
+ * shared mapping, and dropped if it was overwritten mid-copy), the ones clubar
+ * couldn't keep up with are skipped.
+ */
+#ifndef __CLUBAR__RINGBUF_H__
+#define __CLUBAR__RINGBUF_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define RINGBUF_SOURCE    "ring" // channel source, for ring buffer channels.
+#define RINGBUF_MAGIC     0x636c7562
+#define RINGBUF_SLOTS     (1 << 3)
+#define RINGBUF_SLOT_SIZE (1 << 10)
+
+typedef struct RingSlot {
+    uint64_t seq; // sequence number of the record in 'data' (0 while written).
+    char data[RINGBUF_SLOT_SIZE];
+} RingSlot;
+
+typedef struct RingBuf {
+    uint32_t magic;
+    uint64_t head; // sequence number of the latest committed record.
+    RingSlot slots[RINGBUF_SLOTS];
+} RingBuf;
+
+typedef struct RingProducer {
+    RingBuf *ring;
+    int eventfd;
+} RingProducer;
+
+// Requests the ring buffer (shared memory fd and eventfd) of 'channel' over
+// the control socket, returns 0 on success.
+static inline int ringbuf_connect(RingProducer *p, const char *socket_path,
+                                  const char *channel)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    char request[64], byte;
+    int sock, fds[2], nrequest;
+    union {
+        struct cmsghdr hdr;
+        char buffer[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov   = {.iov_base = &byte, .iov_len = 1};
+    struct msghdr msg  = {.msg_iov        = &iov,
+                          .msg_iovlen     = 1,
+                          .msg_control    = control.buffer,
+                          .msg_controllen = sizeof(control.buffer)};
+    struct cmsghdr *cmsg;
+
+    p->ring = NULL, p->eventfd = -1;
+    nrequest = snprintf(request, sizeof(request), "ring %s\n", channel);
+    if (strlen(socket_path) >= sizeof(addr.sun_path) ||
+        nrequest >= (int)sizeof(request))
+        return -1;
+    strcpy(addr.sun_path, socket_path);
+    if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        write(sock, request, nrequest) != nrequest ||
+        recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) <= 0 ||
+        !(cmsg = CMSG_FIRSTHDR(&msg)) || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        close(sock);
+        return -1;
+    }
+    close(sock);
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    p->ring = (RingBuf *)mmap(NULL, sizeof(RingBuf), PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fds[0], 0);
+    close(fds[0]);
+    if (p->ring == MAP_FAILED || p->ring->magic != RINGBUF_MAGIC) {
+        if (p->ring != MAP_FAILED)
+            munmap(p->ring, sizeof(RingBuf));
+        close(fds[1]);
+        p->ring = NULL;
+        return -1;
+    }
+    p->eventfd = fds[1];
+    return 0;
+}
+
+// Commits 'text' (truncated to 'RINGBUF_SLOT_SIZE - 1' bytes) as the latest
+// record, and wakes up clubar.
+static inline void ringbuf_commit(RingProducer *p, const char *text)
+{
+    uint64_t seq = p->ring->head + 1, one = 1;
+    RingSlot *slot = &p->ring->slots[seq % RINGBUF_SLOTS];
+    size_t len     = strnlen(text, RINGBUF_SLOT_SIZE - 1);
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(slot->data, text, len);
+    slot->data[len] = 0;
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&p->ring->head, seq, __ATOMIC_RELEASE);
+    if (write(p->eventfd, &one, sizeof(one)) < 0)
+        (void)0; // counter overflow (clubar is gone), nothing to do.
+}
+
+static inline void ringbuf_disconnect(RingProducer *p)
+{
+    if (p->ring)
+        munmap(p->ring, sizeof(RingBuf));
+    if (p->eventfd >= 0)
+        close(p->eventfd);
+    p->ring = NULL, p->eventfd = -1;
+}
+
+#endif
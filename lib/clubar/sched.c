@@ -0,0 +1,98 @@
+#include "sched.h"
+#include <stdint.h>
+#include <sys/poll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct SchedEntry {
+    bool timer, pending;
+    SchedCallback callback;
+    void *ctx;
+} SchedEntry;
+
+static SchedEntry entries[MAX_SCHED_ENTRIES];
+static struct pollfd pfds[MAX_SCHED_ENTRIES];
+static int nentries = 0;
+
+// Periodic timers are aligned to (wall clock) multiples of the interval, so
+// that e.g. a clock ticking every second, ticks on the second. The first run
+// doesn't wait for the timer though (entry is 'pending' right away).
+bool sched_every(double seconds, SchedCallback callback, void *ctx)
+{
+    int fd;
+    uint64_t interval = seconds * 1e9, now, first;
+    struct timespec ts;
+
+    if (nentries == MAX_SCHED_ENTRIES || interval == 0)
+        return false;
+    if ((fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+        return false;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now   = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    first = (now / interval + 1) * interval;
+    struct itimerspec its = {
+        .it_interval = {interval / 1000000000ull, interval % 1000000000ull},
+        .it_value    = {first / 1000000000ull, first % 1000000000ull},
+    };
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        close(fd);
+        return false;
+    }
+
+    pfds[nentries]    = (struct pollfd){.fd = fd, .events = POLLIN};
+    entries[nentries] = (SchedEntry){true, true, callback, ctx};
+    nentries++;
+    return true;
+}
+
+// 'callback' is called whenever 'fd' is readable (or hung up).
+bool sched_watch(int fd, SchedCallback callback, void *ctx)
+{
+    if (nentries == MAX_SCHED_ENTRIES)
+        return false;
+    pfds[nentries]    = (struct pollfd){.fd = fd, .events = POLLIN};
+    entries[nentries] = (SchedEntry){false, false, callback, ctx};
+    nentries++;
+    return true;
+}
+
+// entries are only marked here (as this might be called from a callback, while
+// iterating over them), and are cleaned up after the callbacks are done.
+void sched_unwatch(int fd)
+{
+    for (int i = 0; i < nentries; ++i)
+        if (pfds[i].fd == fd)
+            pfds[i].fd = -1, pfds[i].revents = 0;
+}
+
+static inline void sched_compact(void)
+{
+    int n = 0;
+    for (int i = 0; i < nentries; ++i)
+        if (pfds[i].fd >= 0)
+            pfds[n] = pfds[i], entries[n++] = entries[i];
+    nentries = n;
+}
+
+// Waits (for at most 'timeout' milliseconds) for any of the entries to be due,
+// and runs the callbacks of the ones that are.
+void sched_poll(int timeout)
+{
+    uint64_t expirations;
+    for (int i = 0; i < nentries; ++i)
+        if (entries[i].pending && !(entries[i].pending = false))
+            entries[i].callback(entries[i].ctx), timeout = 0;
+
+    if (poll(pfds, nentries, timeout) <= 0)
+        return;
+    for (int i = 0, n = nentries; i < n; ++i) {
+        if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+        if (!entries[i].timer ||
+            read(pfds[i].fd, &expirations, sizeof(expirations)) > 0)
+            entries[i].callback(entries[i].ctx);
+    }
+    sched_compact();
+}
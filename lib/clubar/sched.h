@@ -0,0 +1,20 @@
+/* A tiny (single threaded) scheduler for in-process producers.
+ * Every entry is backed by a file descriptor (timerfd for periodic entries),
+ * so that a single 'poll' can wait on all of them.
+ * Entries can be added/removed from within the callbacks as well.
+ */
+#ifndef __CLUBAR__SCHED_H__
+#define __CLUBAR__SCHED_H__
+
+#include <stdbool.h>
+
+#define MAX_SCHED_ENTRIES (1 << 6)
+
+typedef void (*SchedCallback)(void *);
+
+bool sched_every(double, SchedCallback, void *);
+bool sched_watch(int, SchedCallback, void *);
+void sched_unwatch(int);
+void sched_poll(int);
+
+#endif
@@ -0,0 +1,83 @@
+#include "segments.h"
+#include <clubar.h>
+#include <string.h>
+
+static Block scratch[MAX_BLKS];
+
+static inline Segment *segment_find(Segments *segments, const char *name)
+{
+    for (int i = 0; i < segments->nsegments; ++i)
+        if (strcmp(segments->list[i].name, name) == 0)
+            return &segments->list[i];
+    return NULL;
+}
+
+// resizes 'segment' to 'n' blocks (moving the blocks of the segments after it),
+// returns the updated total number of blocks.
+static inline int segment_resize(Segments *segments, Segment *segment,
+                                 Block *blks, int nblks, int n)
+{
+    int tail = segment->offset + segment->nblks, delta = n - segment->nblks;
+    memmove(&blks[tail + delta], &blks[tail], (nblks - tail) * sizeof(Block));
+    // the (now) unused blocks at the end mustn't share tags with the moved
+    // ones.
+    for (int i = nblks + delta; i < nblks; ++i)
+        memset(blks[i].tags, 0, sizeof(blks[i].tags));
+    for (Segment *s = segment + 1; s < segments->list + segments->nsegments;
+         ++s)
+        s->offset += delta;
+    segment->nblks = n;
+    return nblks + delta;
+}
+
+// Creates (appended to the end) or updates the segment 'name' with the blocks
+// parsed from 'line', returns the updated total number of blocks.
+int segments_set(Segments *segments, Block *blks, int nblks, const char *name,
+                 const char *line)
+{
+    Segment *segment = segment_find(segments, name);
+    if (!segment) {
+        if (segments->nsegments == MAX_SEGMENTS)
+            return nblks;
+        segment = &segments->list[segments->nsegments++];
+        snprintf(segment->name, sizeof(segment->name), "%s", name);
+        segment->offset = nblks, segment->nblks = 0;
+    }
+
+    // blocks that don't fit (beside the other segments), are dropped.
+    int n = blks_create(scratch, MAX_BLKS - (nblks - segment->nblks), line);
+    blks_free(&blks[segment->offset], segment->nblks);
+    nblks = segment_resize(segments, segment, blks, nblks, n);
+    memcpy(&blks[segment->offset], scratch, n * sizeof(Block));
+    return nblks;
+}
+
+// Only the text of the placeholder blocks ('<Var=var>') of the segment is
+// replaced (taken as is, not parsed), returns the number of blocks updated.
+int segments_fill(Segments *segments, Block *blks, const char *name,
+                  const char *var, const char *value)
+{
+    Segment *segment = segment_find(segments, name);
+    int n            = 0;
+    for (int i = 0; segment && i < segment->nblks; ++i) {
+        Block *blk = &blks[segment->offset + i];
+        if (blk->tags[Var] && strcmp(blk->tags[Var]->val, var) == 0)
+            snprintf(blk->text, sizeof(blk->text), "%s", value), n++;
+    }
+    return n;
+}
+
+// returns the updated total number of blocks.
+int segments_remove(Segments *segments, Block *blks, int nblks,
+                    const char *name)
+{
+    Segment *segment = segment_find(segments, name);
+    if (!segment)
+        return nblks;
+    blks_free(&blks[segment->offset], segment->nblks);
+    nblks = segment_resize(segments, segment, blks, nblks, 0);
+    memmove(segment, segment + 1,
+            (segments->list + --segments->nsegments - segment) *
+                sizeof(Segment));
+    return nblks;
+}
@@ -0,0 +1,32 @@
+/* Segments are named (and ordered) slices of a channel's blocks, that can be
+ * updated individually, without re-parsing the rest of the channel.
+ *
+ *   blks:     [ cpu.0 | cpu.1 | vol.0 | date.0 | date.1 ]
+ *   segments: { cpu: (0, 2), vol: (2, 1), date: (3, 2) }
+ *
+ * Segments can also be used as (pre-parsed) templates, placeholders i.e.
+ * '<Var=name>' are blocks of their own, that can be filled with plain text.
+ */
+#ifndef __CLUBAR__SEGMENTS_H__
+#define __CLUBAR__SEGMENTS_H__
+
+#include <clubar/blocks.h>
+
+#define MAX_SEGMENTS (1 << 5)
+
+typedef struct Segment {
+    char name[32];
+    int offset, nblks;
+} Segment;
+
+typedef struct Segments {
+    Segment list[MAX_SEGMENTS];
+    int nsegments;
+} Segments;
+
+int segments_set(Segments *, Block *, int, const char *, const char *);
+int segments_remove(Segments *, Block *, int, const char *);
+int segments_fill(Segments *, Block *, const char *, const char *,
+                  const char *);
+
+#endif
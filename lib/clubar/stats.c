@@ -0,0 +1,86 @@
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// counters are updated from multiple threads (stdin, gui, signals), relaxed
+// atomics are enough as these are only ever read for reporting.
+static StatValue stats[NullStatName];
+
+#define ATOMIC_ADD(ptr, val) __atomic_fetch_add(ptr, val, __ATOMIC_RELAXED)
+#define ATOMIC_LOAD(ptr)     __atomic_load_n(ptr, __ATOMIC_RELAXED)
+
+void stats_count(StatName name) { ATOMIC_ADD(&stats[name].count, 1); }
+
+void stats_add(StatName name, uint64_t n)
+{
+    ATOMIC_ADD(&stats[name].count, n);
+}
+
+void stats_time(StatName name, uint64_t ns)
+{
+    ATOMIC_ADD(&stats[name].count, 1);
+    ATOMIC_ADD(&stats[name].total, ns);
+    for (uint64_t max = ATOMIC_LOAD(&stats[name].max); ns > max;)
+        if (__atomic_compare_exchange_n(&stats[name].max, &max, ns, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+}
+
+// Start time of the process (same clock as 'stats_now'), 0 if unavailable.
+// procfs has it in clock ticks since boot, hence the conversion.
+uint64_t stats_process_start(void)
+{
+    char buffer[1 << 10], *p;
+    struct timespec boot;
+    FILE *fp = fopen("/proc/self/stat", "r");
+    size_t n = fp ? fread(buffer, 1, sizeof(buffer) - 1, fp) : 0;
+    if (fp)
+        fclose(fp);
+    buffer[n] = 0;
+
+    // 'starttime' is the 22nd field, the 2nd one (comm) might have spaces.
+    p = strrchr(buffer, ')');
+    for (int field = 2; p && field < 22; ++field)
+        p = strchr(p + 1, ' ');
+    if (!p || clock_gettime(CLOCK_BOOTTIME, &boot) < 0)
+        return 0;
+
+    uint64_t ticks = strtoull(p + 1, NULL, 10),
+             start = ticks * 1000000000ull / sysconf(_SC_CLK_TCK),
+             since = (uint64_t)boot.tv_sec * 1000000000ull + boot.tv_nsec,
+             now   = stats_now();
+    return since - start < now ? now - (since - start) : 0;
+}
+
+StatValue stats_get(StatName name)
+{
+    return (StatValue){.count = ATOMIC_LOAD(&stats[name].count),
+                       .total = ATOMIC_LOAD(&stats[name].total),
+                       .max   = ATOMIC_LOAD(&stats[name].max)};
+}
+
+void stats_dump(FILE *fp)
+{
+    for (StatName name = 0; name < NullStatName; ++name) {
+        StatValue stat = stats_get(name);
+        if (stat.total)
+            fprintf(fp, "%-16s %10lu  avg: %9.3fus  max: %9.3fus\n",
+                    StatNameRepr[name], stat.count,
+                    stat.total / 1e3 / stat.count, stat.max / 1e3);
+        else
+            fprintf(fp, "%-16s %10lu\n", StatNameRepr[name], stat.count);
+    }
+    // hit rates of the caches (of the ones that were used).
+    static const StatName caches[][2] = {{StatImageHit, StatImageMiss},
+                                         {StatMemoHit, StatMemoMiss}};
+    for (size_t i = 0; i < sizeof(caches) / sizeof(*caches); ++i) {
+        char label[32];
+        uint64_t hits   = stats_get(caches[i][0]).count,
+                 misses = stats_get(caches[i][1]).count;
+        snprintf(label, sizeof(label), "%s_rate", StatNameRepr[caches[i][0]]);
+        if (hits + misses)
+            fprintf(fp, "%-16s %9.1f%%\n", label,
+                    100. * hits / (hits + misses));
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef __CLUBAR__STATS_H__
+#define __CLUBAR__STATS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define Enum(ident, ...) typedef enum { __VA_ARGS__, Null##ident } ident
+Enum(StatName, StatParse, StatDraw, StatSpawn, StatFirstFrame, StatRingDropped,
+     StatLineDropped, StatImageHit, StatImageMiss, StatMemoHit, StatMemoMiss);
+#undef Enum
+
+typedef struct StatValue {
+    uint64_t count, total, max;
+} StatValue;
+
+#define REPR(sym, repr) [sym] = repr
+static const char *const StatNameRepr[NullStatName] = {
+    REPR(StatParse, "parse"),
+    REPR(StatDraw, "draw"),
+    REPR(StatSpawn, "spawn"),
+    REPR(StatFirstFrame, "first_frame"),
+    REPR(StatRingDropped, "ring_dropped"),
+    REPR(StatLineDropped, "line_dropped"),
+    REPR(StatImageHit, "image_hit"),
+    REPR(StatImageMiss, "image_miss"),
+    REPR(StatMemoHit, "memo_hit"),
+    REPR(StatMemoMiss, "memo_miss"),
+};
+#undef REPR
+
+static inline uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#define STATS_TIMED(name)                                                      \
+    for (uint64_t __start = stats_now(), __once = 1; __once;                   \
+         __once = 0, stats_time(name, stats_now() - __start))
+
+void stats_count(StatName);
+void stats_add(StatName, uint64_t);
+void stats_time(StatName, uint64_t);
+uint64_t stats_process_start(void);
+StatValue stats_get(StatName);
+void stats_dump(FILE *);
+
+#endif
@@ -2,8 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define TAG_STASH_CAPACITY (1 << 5)
-
+// Released tags are never freed, the stash grows up to the most tags ever
+// alive at once, so once warmed up, (re)parsing lines doesn't allocate. The
 // lifetime for this is going to be the entire runtime of the application, (no
 // need to explicitly free).
 static Tag *stash = NULL;
@@ -14,25 +14,28 @@ static inline Tag *tag_request(void)
         return malloc(sizeof(Tag));
     Tag *tag = stash;
     stash    = stash->previous;
-    memset(tag->val, 0, sizeof(tag->val));
-    tag->previous = NULL, tag->tmod_mask = 0x0;
     return tag;
 }
 
-static inline void tag_release(Tag *tag)
+static inline void tag_release(Tag *tag) { tag->previous = stash, stash = tag; }
+
+// size of the value, including all the words (of action tags), but not the
+// terminating (empty) word.
+static inline size_t tag_val_size(const char *val)
 {
-    // Storing tag allocator size in 'tmod_mask'.
-    tag->tmod_mask = stash ? stash->tmod_mask + 1 : 0;
-    if (tag->tmod_mask == TAG_STASH_CAPACITY)
-        free(tag);
-    else
-        tag->previous = stash, stash = tag;
+    const char *word = val;
+    while (*word)
+        word += strlen(word) + 1;
+    return word - val;
 }
 
 Tag *tag_create(Tag *previous, const char *val, TagModifierMask tmod_mask)
 {
-    Tag *tag = tag_request();
-    strcpy(tag->val, val);
+    Tag *tag    = tag_request();
+    size_t size = tag_val_size(val);
+    // values are bounded by the parser, leaving room for the empty word.
+    memcpy(tag->val, val, size);
+    tag->val[size] = 0;
     tag->tmod_mask = tmod_mask, tag->previous = previous;
     return tag;
 }
@@ -1,6 +1,7 @@
 #ifndef __CLUBAR__TAGS_H__
 #define __CLUBAR__TAGS_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define BLK_BUFFER_SIZE (1 << 10)
@@ -9,7 +10,8 @@
 #define TagEnd   ">"
 
 #define Enum(ident, ...) typedef enum { __VA_ARGS__, Null##ident } ident
-Enum(TagName, Fn, Fg, Bg, Box, BtnL, BtnM, BtnR, ScrlU, ScrlD);
+Enum(TagName, Fn, Fg, Bg, Box, BtnL, BtnM, BtnR, ScrlU, ScrlD, Graph,
+     Img, Var, Style, Gap);
 Enum(TagModifier, Shift, Ctrl, Super, Alt, Left, Right, Top, Bottom);
 #undef Enum
 
@@ -31,12 +33,32 @@ static const TagModifierMask ValidTagModifiers[NullTagName] = {
     [BtnR]  = (1 << Shift) | (1 << Ctrl) | (1 << Super) | (1 << Alt),
     [ScrlU] = (1 << Shift) | (1 << Ctrl) | (1 << Super) | (1 << Alt),
     [ScrlD] = (1 << Shift) | (1 << Ctrl) | (1 << Super) | (1 << Alt),
+    [Graph] = 0,
+    [Img]   = 0,
+    [Var]   = 0,
+    [Style] = 0,
+    [Gap]   = 0,
+};
+
+// values of action tags are split into (nul separated) words at parse time,
+// terminated by an empty word (eg: "notify-send\0hello\0\0").
+static const bool ActionTags[NullTagName] = {
+    [BtnL] = true, [BtnM] = true, [BtnR] = true, [ScrlU] = true, [ScrlD] = true,
+};
+
+// void tags (no closing tag) make up a block of their own, without any text.
+static const bool VoidTags[NullTagName] = {
+    [Graph] = true,
+    [Img]   = true,
+    [Var]   = true,
+    [Gap]   = true,
 };
 
 #define REPR(sym) [sym] = #sym
 static const char *const TagNameRepr[NullTagName] = {
     REPR(Fn),   REPR(Fg),   REPR(Bg),    REPR(Box),   REPR(BtnL),
-    REPR(BtnM), REPR(BtnR), REPR(ScrlU), REPR(ScrlD),
+    REPR(BtnM), REPR(BtnR), REPR(ScrlU), REPR(ScrlD), REPR(Graph),
+    REPR(Img),  REPR(Var),  REPR(Style), REPR(Gap),
 };
 static const char *const TagModifierRepr[NullTagModifier] = {
     REPR(Shift), REPR(Ctrl),  REPR(Super), REPR(Alt),
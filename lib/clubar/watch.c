@@ -0,0 +1,76 @@
+#include "watch.h"
+#include <libgen.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static struct {
+    int inotifyfd, timerfd;
+    char name[NAME_MAX + 1];
+    SchedCallback callback;
+    void *ctx;
+} watch = {.inotifyfd = -1, .timerfd = -1};
+
+static void on_settled(void *ctx)
+{
+    (void)ctx;
+    uint64_t expirations;
+    if (read(watch.timerfd, &expirations, sizeof(expirations)) > 0)
+        watch.callback(watch.ctx);
+}
+
+// every (relevant) event just pushes the timer further.
+static void on_change(void *ctx)
+{
+    (void)ctx;
+    char buffer[sizeof(struct inotify_event) + NAME_MAX + 1]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *e;
+    bool changed = false;
+    ssize_t n;
+
+    while ((n = read(watch.inotifyfd, buffer, sizeof(buffer))) > 0)
+        for (char *p = buffer; p < buffer + n; p += sizeof(*e) + e->len)
+            if ((e = (const struct inotify_event *)p)->len &&
+                strcmp(e->name, watch.name) == 0)
+                changed = true;
+    if (changed) {
+        struct itimerspec its = {
+            .it_value = {WATCH_DEBOUNCE_MS / 1000,
+                         (WATCH_DEBOUNCE_MS % 1000) * 1000000},
+        };
+        timerfd_settime(watch.timerfd, 0, &its, NULL);
+    }
+}
+
+bool watch_file(const char *path, SchedCallback callback, void *ctx)
+{
+    char dir[PATH_MAX], base[PATH_MAX];
+    if (strlen(path) >= sizeof(dir) || watch.inotifyfd >= 0)
+        return false;
+    // 'dirname' and 'basename' might modify their argument.
+    strcpy(dir, path), strcpy(base, path);
+    if (strlen(basename(base)) >= sizeof(watch.name))
+        return false;
+    strcpy(watch.name, basename(base));
+    watch.callback = callback, watch.ctx = ctx;
+
+    if ((watch.inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+        (watch.timerfd = timerfd_create(CLOCK_MONOTONIC,
+                                        TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+        inotify_add_watch(watch.inotifyfd, dirname(dir),
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0 ||
+        !sched_watch(watch.inotifyfd, on_change, NULL) ||
+        !sched_watch(watch.timerfd, on_settled, NULL)) {
+        if (watch.inotifyfd >= 0)
+            sched_unwatch(watch.inotifyfd), close(watch.inotifyfd);
+        if (watch.timerfd >= 0)
+            sched_unwatch(watch.timerfd), close(watch.timerfd);
+        watch.inotifyfd = watch.timerfd = -1;
+        return false;
+    }
+    return true;
+}
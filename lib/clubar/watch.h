@@ -0,0 +1,15 @@
+/* Watches a (config) file for changes with inotify, and calls back once the
+ * writes have settled down (debounced), e.g. editors tend to write a file in
+ * multiple steps, or replace it altogether (which is why the parent directory
+ * is watched rather than the file itself).
+ */
+#ifndef __CLUBAR__WATCH_H__
+#define __CLUBAR__WATCH_H__
+
+#include <clubar/sched.h>
+
+#define WATCH_DEBOUNCE_MS 200
+
+bool watch_file(const char *, SchedCallback, void *);
+
+#endif
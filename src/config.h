@@ -30,6 +30,16 @@ static const char foreground[] = "#efefef";
 
 static const char background[] = "#090909";
 
+// repeated actions using '%n' (e.g. a scroll wheel flick), within this many
+// milliseconds, are executed once, with '%n' as the count (0 to disable).
+static const unsigned int coalesce_ms = 100;
+
+// 'name:markup', the 'workspaces' module uses 'workspace' and
+// 'workspace_current' (for the current desktop).
+static const char *const styles[] = {
+    "workspace_current:<Box:Bottom=#efefef:2>",
+};
+
 // This cannot be empty, first font is the default;
 static const char *const fonts[] = {"monospace-9", "monospace-9:bold"};
 
@@ -1,7 +1,25 @@
 #include "gui.h"
+#include "raster.h"
 #include <X11/Xatom.h>
 #include <X11/Xft/Xft.h>
 #include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+#ifdef __ENABLE_RANDR__
+#include <X11/extensions/Xrandr.h>
+#endif
+#include <clubar/graphs.h>
+#include <clubar/i3bar.h>
+#include <clubar/image.h>
+#include <clubar/memo.h>
+#include <clubar/probes.h>
+#include <clubar/stats.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 static CluBar _clubar = {0};
@@ -19,20 +37,32 @@ typedef struct ColorCache {
     struct ColorCache *prev, *next;
 } ColorCache;
 
-#define CC_ATTACH(c)                                                           \
-    do { /* Attach item on top of the 'drw.colorcache' linked list.*/          \
-        if ((c->prev = NULL, c->next = drw.colorcache))                        \
-            drw.colorcache->prev = c;                                          \
-        drw.colorcache = c;                                                    \
+typedef struct ImageCache {
+    char path[BLK_BUFFER_SIZE];
+    struct timespec mtime;
+    Picture picture; // 'None', if the image couldn't be loaded.
+    uint32_t *pixels; // instead of 'picture', with the raster (client side).
+    int width, height;
+    size_t size;
+    struct ImageCache *prev, *next;
+} ImageCache;
+
+#define LRU_ATTACH(head, c)                                                    \
+    do { /* Attach item on top of the 'head' linked list.*/                    \
+        if ((c->prev = NULL, c->next = head))                                  \
+            head->prev = c;                                                    \
+        head = c;                                                              \
     } while (0)
 
-#define CC_DETACH(c)                                                           \
-    do { /* Detach item from the 'drw.colorcache' linked list.*/               \
-        (void)(c->prev ? (c->prev->next = c->next)                             \
-                       : (drw.colorcache = c->next));                          \
+#define LRU_DETACH(head, c)                                                    \
+    do { /* Detach item from the 'head' linked list.*/                         \
+        (void)(c->prev ? (c->prev->next = c->next) : (head = c->next));        \
         (void)(c->next ? (c->next->prev = c->prev) : 0);                       \
     } while (0)
 
+#define CC_ATTACH(c) LRU_ATTACH(drw.colorcache, c)
+#define CC_DETACH(c) LRU_DETACH(drw.colorcache, c)
+
 #define CC_FREE(cc)                                                            \
     do {                                                                       \
         __typeof__(cc) tmp = (cc);                                             \
@@ -43,22 +73,69 @@ typedef struct ColorCache {
 
 static struct DrawContext {
     int nfonts;
-    XftFont **fonts;
-    GlyphInfo gis[2][MAX_BLKS];
+    XftFont **fonts; // opened on first use (NULL until then), except font 0.
+    char **fontnames;
+    GlyphInfo gis[MAX_CHANNELS][MAX_BLKS];
+    GlyphInfo regions[MAX_CHANNELS]; // area covered by each of the channels.
     ColorCache *colorcache;
+    ImageCache *imagecache;
+    size_t imagecache_size;
+    XftColor foreground, background;
+    bool shm; // frames are rasterized on the client (see 'raster.h').
+    // channels are laid out (once) on this canvas, and every bar just shifts
+    // the result, as per the width of its own canvas.
+    Geometry canvas_g;
 } drw = {0};
 
+#define MAX_BARS (1 << 3)
+
+// one bar per (RandR) output, all of them draw the same (shared) blocks.
 static struct Bar {
     Window window;
     XftDraw *canvas;
+    Raster raster; // only with 'drw.shm'.
     Geometry window_g, canvas_g;
-    XftColor foreground, background;
-} bar = {0};
+    bool mapped, obscured;
+} bars[MAX_BARS] = {0}, *bar = bars; // 'bar' is the one being drawn on.
+static int nbars = 0;
+
+#define FOR_EACH_BAR for (bar = bars; bar < bars + nbars; ++bar)
+
+#ifdef __ENABLE_RANDR__
+static int randr_event_base = -1;
+#endif
 
-enum { WMName, NetWMWindowType, NetWMDock, NetWMStrut, NullWMAtom };
+enum {
+    WMName,
+    NetWMWindowType,
+    NetWMDock,
+    NetWMStrut,
+    NetWMName,
+    NetNumberOfDesktops,
+    NetCurrentDesktop,
+    NetDesktopNames,
+    NetActiveWindow,
+    UTF8String,
+    NullWMAtom
+};
 Atom atoms[NullWMAtom];
 
-#define fill_rect(...)    XftDrawRect(bar.canvas, &bar.background, __VA_ARGS__)
+static inline void draw_rect(const XftColor *color, int x, int y, int w, int h)
+{
+    if (drw.shm)
+        raster_fill(&bar->raster, color, x, y, w, h);
+    else
+        XftDrawRect(bar->canvas, color, x, y, w, h);
+}
+
+// the frame is presented with a single request (only the damaged area).
+static inline void bar_present(void)
+{
+    if (drw.shm)
+        raster_present(&bar->raster, bar->window);
+}
+
+#define fill_rect(...)    draw_rect(&drw.background, __VA_ARGS__)
 #define alloc_color(p, c) XftColorAllocName(dpy(), vis(), cmap(), c, p)
 
 static XftColor *request_color(const char *colorname)
@@ -73,143 +150,437 @@ static XftColor *request_color(const char *colorname)
         }
     }
     XftColor xft_color;
+    PROBE1(color_miss, colorname);
     if (!alloc_color(&xft_color, colorname))
-        return &bar.foreground;
+        return &drw.foreground;
 
-    if (capacity)
-        capacity--;
-    else if (last)
-        CC_FREE(last);
-    ColorCache *color = (ColorCache *)malloc(sizeof(ColorCache));
+    // once the cache is full, the least recently used entry is reused (no
+    // allocations for new colors, after warm up).
+    ColorCache *color;
+    if (capacity || !last) {
+        capacity -= capacity > 0;
+        color = (ColorCache *)malloc(sizeof(ColorCache));
+    } else {
+        CC_DETACH(last);
+        XftColorFree(dpy(), vis(), cmap(), &last->val);
+        color = last;
+    }
     memmove(&color->val, &xft_color, sizeof(xft_color));
     strcpy(color->name, colorname);
     CC_ATTACH(color);
     return &drw.colorcache->val;
 }
 
-static inline void drw_init(const Config *config)
+// decoded pixels (and the cache entries) are limited to this many bytes.
+#define IMAGE_CACHE_BUDGET (1 << 22)
+
+static inline void image_evict(ImageCache *img)
 {
-    // As this function can be called multiple times, we need to deallocate the
-    // previously allocated stuff.
-    for (int i = 0; i < drw.nfonts; ++i)
-        XftFontClose(dpy(), drw.fonts[i]);
-    if (drw.fonts) {
-        free(drw.fonts);
-        drw.fonts = NULL;
+    LRU_DETACH(drw.imagecache, img);
+    if (img->picture != None)
+        XRenderFreePicture(dpy(), img->picture);
+    free(img->pixels);
+    drw.imagecache_size -= img->size;
+    free(img);
+}
+
+// shrinks the image cache (least recently used ones are at the end), down to
+// 'floor' bytes.
+static inline void images_trim(size_t floor)
+{
+    while (drw.imagecache && drw.imagecache_size > floor) {
+        ImageCache *last = drw.imagecache;
+        while (last->next)
+            last = last->next;
+        image_evict(last);
     }
+}
 
-    drw.nfonts = config->nfonts;
-    drw.fonts  = (XftFont **)realloc(drw.fonts, drw.nfonts * sizeof(XftFont *));
-    for (int i = 0; i < drw.nfonts; ++i)
-        drw.fonts[i] = XftFontOpenName(dpy(), scr(), config->fonts[i]);
+// uploaded once, drawing the image is then just a composite (server side).
+static inline Picture image_upload(const Image *image)
+{
+    Pixmap pixmap =
+        XCreatePixmap(dpy(), root(), image->width, image->height, 32);
+    GC gc = XCreateGC(dpy(), pixmap, 0, NULL);
+    XImage *ximage =
+        XCreateImage(dpy(), vis(), 32, ZPixmap, 0, (char *)image->pixels,
+                     image->width, image->height, 32, 0);
+    // pixels are in native byte order, Xlib swaps them if the server differs.
+    ximage->byte_order = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? LSBFirst
+                                                                   : MSBFirst;
+    XPutImage(dpy(), pixmap, gc, ximage, 0, 0, 0, 0, image->width,
+              image->height);
+    ximage->data = NULL; // owned by 'image'.
+    XDestroyImage(ximage);
 
-    while (drw.colorcache)
-        CC_FREE(drw.colorcache);
-    drw.colorcache = NULL;
+    Picture picture = XRenderCreatePicture(
+        dpy(), pixmap, XRenderFindStandardFormat(dpy(), PictStandardARGB32), 0,
+        NULL);
+    XFreeGC(dpy(), gc);
+    XFreePixmap(dpy(), pixmap);
+    return picture;
 }
 
-static inline void bar_init(const Config *config)
+// Images are cached by path, and the file's mtime is only checked when
+// 'revalidate' is set (i.e. when the block is measured, not on every redraw).
+static ImageCache *request_image(const char *path, bool revalidate)
 {
-    Geometry geometry = config->geometry;
+    struct stat st;
+    struct timespec mtime = {0};
+    Image image;
+    ImageCache *img = drw.imagecache;
+    while (img && strcmp(img->path, path) != 0)
+        img = img->next;
 
-    if (!bar.window)
-        bar.window = XCreateSimpleWindow(dpy(), root(), 0, 0, 10, 10, 0, 0, 0);
-    if (!bar.canvas)
-        bar.canvas = XftDrawCreate(dpy(), bar.window, vis(), cmap());
-
-    /* window geometry and placement. */ {
-        bar.window_g   = geometry;
-        bar.canvas_g.x = config->padding.left;
-        bar.canvas_g.y = config->padding.top;
-        bar.canvas_g.w =
-            bar.window_g.w - config->padding.left - config->padding.right;
-        bar.canvas_g.h =
-            bar.window_g.h - config->padding.top - config->padding.bottom;
-        XMoveResizeWindow(dpy(), bar.window, bar.window_g.x, bar.window_g.y,
-                          bar.window_g.w, bar.window_g.h);
+    if (!img || revalidate)
+        if (stat(path, &st) == 0)
+            mtime = st.st_mtim;
+    if (img && (!revalidate || (img->mtime.tv_sec == mtime.tv_sec &&
+                                img->mtime.tv_nsec == mtime.tv_nsec))) {
+        stats_count(StatImageHit);
+        LRU_DETACH(drw.imagecache, img);
+        LRU_ATTACH(drw.imagecache, img);
+        return img;
     }
+    stats_count(StatImageMiss);
+    if (img)
+        image_evict(img);
 
-    /* allocating foreground and background colors for the window. */ {
-        // @TODO: free these colors on reload config.
+    img = (ImageCache *)calloc(1, sizeof(ImageCache));
+    snprintf(img->path, sizeof(img->path), "%s", path);
+    img->mtime = mtime;
+    if (image_load(path, &image)) {
+        img->width = image.width, img->height = image.height;
+        if (drw.shm)
+            img->pixels = image.pixels; // owned by the cache entry now.
+        else
+            img->picture = image_upload(&image), image_free(&image);
+    } else {
+        eprintf("Unable to load image: '%s'.\n", path);
+    }
+    img->size = sizeof(ImageCache) + (size_t)img->width * img->height * 4;
 
-        XftColorFree(dpy(), vis(), cmap(), &bar.foreground);
-        if (!alloc_color(&bar.foreground, config->foreground))
-            alloc_color(&bar.foreground, "#ffffff");
+    images_trim(img->size < IMAGE_CACHE_BUDGET ? IMAGE_CACHE_BUDGET - img->size
+                                               : 0);
+    LRU_ATTACH(drw.imagecache, img);
+    drw.imagecache_size += img->size;
+    return img;
+}
 
-        XftColorFree(dpy(), vis(), cmap(), &bar.background);
-        if (!alloc_color(&bar.background, config->background))
-            alloc_color(&bar.background, "#000000");
+static inline void drw_free_fonts(void)
+{
+    raster_flush_glyphs();
+    for (int i = 0; i < drw.nfonts; ++i) {
+        if (drw.fonts[i])
+            XftFontClose(dpy(), drw.fonts[i]);
+        free(drw.fontnames[i]);
     }
+    free(drw.fonts), free(drw.fontnames);
+    drw.fonts = NULL, drw.fontnames = NULL, drw.nfonts = 0;
+}
+
+// only (re)opens the fonts, cached colors don't depend on the config, and are
+// kept around across reloads. Opening a font is slow (and most of the fonts
+// might never be selected with '<Fn=N>'), so only font 0 is opened right away.
+static inline void drw_init(const Config *config)
+{
+    drw_free_fonts();
+    drw.nfonts    = config->nfonts;
+    drw.fonts     = (XftFont **)calloc(drw.nfonts, sizeof(XftFont *));
+    drw.fontnames = (char **)malloc(drw.nfonts * sizeof(char *));
+    // names are copied, as the config might be reloaded before the fonts are.
+    for (int i = 0; i < drw.nfonts; ++i)
+        drw.fontnames[i] = strdup(config->fonts[i]);
+    if (drw.nfonts)
+        drw.fonts[0] = XftFontOpenName(dpy(), scr(), drw.fontnames[0]);
+}
 
-    /* update window properties. */ {
-        XSetWindowAttributes attrs = {
-            .event_mask = StructureNotifyMask | ExposureMask | ButtonPressMask,
-            .override_redirect = True,
-        };
-        XChangeWindowAttributes(dpy(), bar.window,
-                                CWEventMask | CWOverrideRedirect, &attrs);
+// a font that fails to open is font 0 from then on (until reloaded), instead
+// of being opened again on every glyph. Copies are closed as any other font.
+static inline XftFont *font(int index)
+{
+    if (!drw.fonts[index] &&
+        !(drw.fonts[index] =
+              XftFontOpenName(dpy(), scr(), drw.fontnames[index])) &&
+        drw.fonts[0])
+        drw.fonts[index] = XftFontCopy(dpy(), drw.fonts[0]);
+    return drw.fonts[index] ? drw.fonts[index] : drw.fonts[0];
+}
 
-        XChangeProperty(dpy(), bar.window, atoms[NetWMWindowType], XA_ATOM, 32,
-                        PropModeReplace, (uint8_t *)&atoms[NetWMDock],
-                        sizeof(Atom));
+#define CHANGED(changes, change) ((changes) & (1 << (change)))
 
-        long barheight = bar.window_g.h + clubar->config.margin.top +
-                         clubar->config.margin.bottom;
-        long strut[4] = {0, 0, clubar->config.topbar ? barheight : 0,
-                         !clubar->config.topbar ? barheight : 0};
-        XChangeProperty(dpy(), bar.window, atoms[NetWMStrut], XA_CARDINAL, 32,
+// falls back to XRender for good (e.g. the server couldn't attach a segment),
+// images are then re-uploaded, as they're requested.
+static inline void shm_disable(void)
+{
+    eprintf("MIT-SHM unavailable, falling back to XRender.\n");
+    drw.shm = false;
+    for (int i = 0; i < MAX_BARS; ++i)
+        raster_destroy(&bars[i].raster);
+    images_trim(0);
+}
+
+static inline void bar_create(struct Bar *bar)
+{
+    bar->window = XCreateSimpleWindow(dpy(), root(), 0, 0, 10, 10, 0, 0, 0);
+    XSetWindowAttributes attrs = {
+        .event_mask = StructureNotifyMask | ExposureMask | ButtonPressMask |
+                      VisibilityChangeMask,
+        .override_redirect = True,
+    };
+    XChangeWindowAttributes(dpy(), bar->window,
+                            CWEventMask | CWOverrideRedirect, &attrs);
+    XChangeProperty(dpy(), bar->window, atoms[NetWMWindowType], XA_ATOM, 32,
+                    PropModeReplace, (uint8_t *)&atoms[NetWMDock],
+                    sizeof(Atom));
+    XStoreName(dpy(), bar->window, NAME);
+    XSetClassHint(dpy(), bar->window,
+                  &(XClassHint){.res_name = NAME, .res_class = NAME});
+    bar->canvas = XftDrawCreate(dpy(), bar->window, vis(), cmap());
+}
+
+static inline void bar_destroy(struct Bar *bar)
+{
+    raster_destroy(&bar->raster);
+    XftDrawDestroy(bar->canvas);
+    XDestroyWindow(dpy(), bar->window);
+    *bar = (struct Bar){0};
+}
+
+// only the 'changes' are (re)applied to the window.
+static inline void bar_configure(struct Bar *bar, const Config *config,
+                                 Geometry geometry, ConfigChanges changes)
+{
+    if (CHANGED(changes, ChangedGeometry)) {
+        bar->window_g   = geometry;
+        bar->canvas_g.x = config->padding.left;
+        bar->canvas_g.y = config->padding.top;
+        bar->canvas_g.w =
+            bar->window_g.w - config->padding.left - config->padding.right;
+        bar->canvas_g.h =
+            bar->window_g.h - config->padding.top - config->padding.bottom;
+        XMoveResizeWindow(dpy(), bar->window, bar->window_g.x,
+                          bar->window_g.y, bar->window_g.w, bar->window_g.h);
+        raster_destroy(&bar->raster);
+        if (drw.shm &&
+            !raster_create(&bar->raster, bar->window_g.w, bar->window_g.h))
+            shm_disable();
+    }
+
+    if (CHANGED(changes, ChangedGeometry) || CHANGED(changes, ChangedStrut)) {
+        long barheight = bar->window_g.h + config->margin.top +
+                         config->margin.bottom;
+        long strut[4]  = {0, 0, config->topbar ? barheight : 0,
+                          !config->topbar ? barheight : 0};
+        XChangeProperty(dpy(), bar->window, atoms[NetWMStrut], XA_CARDINAL, 32,
                         PropModeReplace, (uint8_t *)strut, 4l);
-        if (strlen(clubar->config.border_color) > 0) {
-            XftColor *color = request_color(clubar->config.border_color);
-            XSetWindowBorder(dpy(), bar.window, color->pixel);
-            XSetWindowBorderWidth(dpy(), bar.window,
-                                  clubar->config.border_width);
+    }
+
+    if (CHANGED(changes, ChangedBorder)) {
+        if (strlen(config->border_color) > 0) {
+            XftColor *color = request_color(config->border_color);
+            XSetWindowBorder(dpy(), bar->window, color->pixel);
+            XSetWindowBorderWidth(dpy(), bar->window, config->border_width);
         } else {
-            XSetWindowBorderWidth(dpy(), bar.window, 0);
+            XSetWindowBorderWidth(dpy(), bar->window, 0);
+        }
+    }
+}
+
+// Geometries of the bars, one per (distinct) RandR output with '--outputs',
+// derived from the output and the margins (only the configured height is
+// used), otherwise just the configured geometry.
+static inline int bars_geometries(const Config *config,
+                                  Geometry geometries[MAX_BARS])
+{
+    int n = 0;
+#ifdef __ENABLE_RANDR__
+    XRRScreenResources *res;
+    if (config->outputs && randr_event_base >= 0 &&
+        (res = XRRGetScreenResourcesCurrent(dpy(), root()))) {
+        uint32_t h = config->geometry.h, border = 2 * config->border_width;
+        for (int i = 0; i < res->ncrtc && n < MAX_BARS; ++i) {
+            XRRCrtcInfo *crtc = XRRGetCrtcInfo(dpy(), res, res->crtcs[i]);
+            if (!crtc)
+                continue;
+            Geometry g = {
+                .x = crtc->x + config->margin.left,
+                .y = config->topbar ? crtc->y + config->margin.top
+                                    : crtc->y + crtc->height - h - border -
+                                          config->margin.bottom,
+                .w = crtc->width - config->margin.left -
+                     config->margin.right - border,
+                .h = h,
+            };
+            bool duplicate = false; // mirrored outputs.
+            for (int j = 0; j < n; ++j)
+                duplicate |= memcmp(&geometries[j], &g, sizeof(g)) == 0;
+            if (crtc->noutput && crtc->mode != None && !duplicate)
+                geometries[n++] = g;
+            XRRFreeCrtcInfo(crtc);
         }
+        XRRFreeScreenResources(res);
+    }
+#endif
+    if (n == 0)
+        geometries[n++] = config->geometry;
+    return n;
+}
+
+// Creates/destroys bars, as per the current outputs, and applies 'changes'
+// (new bars get everything, moved ones get their geometry updated).
+static inline void bars_update(const Config *config, ConfigChanges changes)
+{
+    Geometry geometries[MAX_BARS];
+    int n = bars_geometries(config, geometries);
+
+    while (nbars > n)
+        bar_destroy(&bars[--nbars]);
+    for (int i = 0; i < n; ++i) {
+        ConfigChanges bar_changes = changes;
+        if (i >= nbars)
+            bar_create(&bars[i]), bar_changes = ALL_CONFIG_CHANGES;
+        else if (memcmp(&bars[i].window_g, &geometries[i], sizeof(Geometry)))
+            bar_changes |= 1 << ChangedGeometry;
+        bar_configure(&bars[i], config, geometries[i], bar_changes);
+        if (i >= nbars)
+            XMapWindow(dpy(), bars[i].window);
     }
+    nbars        = n;
+    drw.canvas_g = bars[0].canvas_g;
+}
+
+static inline void colors_init(const Config *config)
+{
+    XftColorFree(dpy(), vis(), cmap(), &drw.foreground);
+    if (!alloc_color(&drw.foreground, config->foreground))
+        alloc_color(&drw.foreground, "#ffffff");
+
+    XftColorFree(dpy(), vis(), cmap(), &drw.background);
+    if (!alloc_color(&drw.background, config->background))
+        alloc_color(&drw.background, "#000000");
+}
+
+#define channel(blktype) (&clubar->config.channels[blktype])
+
+// 'Width[:Color]', returns the width (in pixels), 'color' (if not NULL) is set
+// to the color of the line (empty, if none).
+static inline int gap_spec(const char *val, char color[32])
+{
+    int width = 0;
+    char line[32] = {0};
+    sscanf(val, "%d:%31s", &width, line);
+    if (color)
+        strcpy(color, line);
+    return width > 0 ? width : 0;
 }
 
-static inline void generate_stdin_gis(void)
+// (Re)calculates the glyph info of every block of the channel, relative to the
+// current position of the channel. The layout of a memoized line is measured
+// once, images aside (their files are revalidated on every measure).
+static inline void generate_gis(BlockType blktype)
 {
     XGlyphInfo extent;
     int fntindex, startx = 0;
-    for (int i = 0; i < clubar->nblks[Stdin]; ++i) {
-        const Block *blk = &clubar->blks[Stdin][i];
-        fntindex = blk->tags[Fn] ? atoi(blk->tags[Fn]->val) % drw.nfonts : 0;
-        XftTextExtentsUtf8(dpy(), drw.fonts[fntindex], (FcChar8 *)blk->text,
-                           strlen(blk->text), &extent);
-        drw.gis[Stdin][i].width = extent.xOff;
-        drw.gis[Stdin][i].x     = startx + extent.x;
-        startx += drw.gis[Stdin][i].width;
+    MemoEntry *memo = clubar->memo[blktype];
+    PROBE1(gis_start, blktype);
+    if (memo && memo->measured) {
+        for (int i = 0; i < memo->nblks; ++i)
+            drw.gis[blktype][i] = (GlyphInfo){
+                .x     = drw.regions[blktype].x + memo->extents[i].x,
+                .width = memo->extents[i].width,
+            };
+        drw.regions[blktype].width = memo->width;
+        PROBE2(gis_end, blktype, memo->width);
+        return;
     }
+    for (int i = 0; i < clubar->nblks[blktype]; ++i) {
+        const Block *blk = &clubar->blks[blktype][i];
+        if (blk->tags[Graph]) {
+            GraphSpec spec;
+            extent.x    = 0;
+            extent.xOff = graph_spec(blk->tags[Graph]->val, &spec) ? spec.width
+                                                                   : 0;
+        } else if (blk->tags[Img]) {
+            extent.x    = 0;
+            extent.xOff = request_image(blk->tags[Img]->val, true)->width;
+            memo        = NULL;
+        } else if (blk->tags[Gap]) {
+            extent.x    = 0;
+            extent.xOff = gap_spec(blk->tags[Gap]->val, NULL);
+        } else {
+            fntindex =
+                blk->tags[Fn] ? atoi(blk->tags[Fn]->val) % drw.nfonts : 0;
+            XftTextExtentsUtf8(dpy(), font(fntindex), (FcChar8 *)blk->text,
+                               strlen(blk->text), &extent);
+        }
+        drw.gis[blktype][i].width = extent.xOff;
+        drw.gis[blktype][i].x     = drw.regions[blktype].x + startx + extent.x;
+        if (memo)
+            memo->extents[i] = (Extent){startx + extent.x, extent.xOff};
+        startx += extent.xOff;
+    }
+    drw.regions[blktype].width = startx;
+    if (memo)
+        memo->width = startx, memo->measured = true;
+    PROBE2(gis_end, blktype, startx);
 }
 
-static inline void generate_custom_gis(void)
+// Channels with the same alignment are stacked next to each other (in order):
+// 'left' ones from the left edge, 'right' ones from the right edge and the
+// 'center' ones are centered as a group.
+static inline void layout_channels(Alignment align)
 {
-    XGlyphInfo extent;
-    int fntindex, startx = bar.canvas_g.x + bar.canvas_g.w;
-    for (int i = clubar->nblks[Custom] - 1; i >= 0; --i) {
-        const Block *blk = &clubar->blks[Custom][i];
-        fntindex = blk->tags[Fn] ? atoi(blk->tags[Fn]->val) % drw.nfonts : 0;
-        XftTextExtentsUtf8(dpy(), drw.fonts[fntindex], (FcChar8 *)blk->text,
-                           strlen(blk->text), &extent);
-        drw.gis[Custom][i].width = extent.xOff;
-        startx -= extent.x + extent.xOff;
-        drw.gis[Custom][i].x = startx;
+    const Geometry *canvas_g = &drw.canvas_g;
+    int total = 0, x;
+    for (BlockType b = 0; b < clubar->config.nchannels; ++b)
+        if (channel(b)->align == align)
+            total += drw.regions[b].width;
+    x = align == AlignLeft     ? (int)canvas_g->x
+        : align == AlignCenter ? (int)(canvas_g->x + (canvas_g->w - total) / 2)
+                               : (int)(canvas_g->x + canvas_g->w);
+
+    for (BlockType b = 0; b < clubar->config.nchannels; ++b) {
+        if (channel(b)->align != align)
+            continue;
+        if (align == AlignRight)
+            x -= drw.regions[b].width;
+        // shifting the already calculated glyph infos, no need to re-measure.
+        int delta = x - drw.regions[b].x;
+        for (int i = 0; delta && i < clubar->nblks[b]; ++i)
+            drw.gis[b][i].x += delta;
+        drw.regions[b].x = x;
+        if (align != AlignRight)
+            x += drw.regions[b].width;
     }
 }
 
+// offset of the channels with alignment 'align' on bar 'b', relative to where
+// they were laid out.
+static inline int bar_shift(const struct Bar *b, Alignment align)
+{
+    int extra = (int)b->canvas_g.w - (int)drw.canvas_g.w;
+    return align == AlignLeft ? 0 : align == AlignCenter ? extra / 2 : extra;
+}
+
+// whether the position of channel 'other' is affected by changes to 'blktype'.
+static inline bool is_dependent(BlockType other, BlockType blktype)
+{
+    Alignment align = channel(blktype)->align;
+    return channel(other)->align == align &&
+           (align == AlignCenter || other >= blktype);
+}
+
 static inline void xrender_bg(const Block *blk, const GlyphInfo *gi)
 {
-    XftDrawRect(bar.canvas, request_color(blk->tags[Bg]->val), gi->x,
-                bar.canvas_g.y, gi->width, bar.canvas_g.h);
+    draw_rect(request_color(blk->tags[Bg]->val), gi->x, bar->canvas_g.y,
+              gi->width, bar->canvas_g.h);
 }
 
 static inline void xrender_box(const Block *blk, const GlyphInfo *gi)
 {
     char color[32];
-    const Geometry *canvas_g = &bar.canvas_g;
+    const Geometry *canvas_g = &bar->canvas_g;
     for (Tag *box = blk->tags[Box]; box != NULL; box = box->previous) {
         int size = parse_color_string(box->val, color);
         if (!size)
@@ -233,7 +604,7 @@ static inline void xrender_box(const Block *blk, const GlyphInfo *gi)
                 } break;
                 default: break;
                 }
-                XftDrawRect(bar.canvas, request_color(color), bx, by, bw, bh);
+                draw_rect(request_color(color), bx, by, bw, bh);
             }
         }
     }
@@ -241,39 +612,264 @@ static inline void xrender_box(const Block *blk, const GlyphInfo *gi)
 
 static inline void xrender_string(const Block *blk, const GlyphInfo *gi)
 {
-    Geometry *canvas_g = &bar.canvas_g;
+    Geometry *canvas_g = &bar->canvas_g;
     int fntindex =
         blk->tags[Fn] != NULL ? atoi(blk->tags[Fn]->val) % drw.nfonts : 0;
-    int starty = canvas_g->y + (canvas_g->h - drw.fonts[fntindex]->height) / 2 +
-                 drw.fonts[fntindex]->ascent;
+    int starty = canvas_g->y + (canvas_g->h - font(fntindex)->height) / 2 +
+                 font(fntindex)->ascent;
     XftColor *fg = blk->tags[Fg] != NULL ? request_color(blk->tags[Fg]->val)
-                                         : &bar.foreground;
-    XftDrawStringUtf8(bar.canvas, fg, drw.fonts[fntindex], gi->x, starty,
-                      (FcChar8 *)blk->text, strlen(blk->text));
+                                         : &drw.foreground;
+    if (drw.shm)
+        raster_string(&bar->raster, font(fntindex), fg, gi->x, starty,
+                      blk->text, strlen(blk->text));
+    else
+        XftDrawStringUtf8(bar->canvas, fg, font(fntindex), gi->x, starty,
+                          (FcChar8 *)blk->text, strlen(blk->text));
 }
 
-static void execute_cmd(char *const cmd)
+// one (1px wide) bar per sample, all of them filled with a single request.
+static inline void xrender_graph(const Block *blk, const GlyphInfo *gi)
 {
-    if (fork())
+    static XRectangle rects[MAX_GRAPH_SAMPLES];
+    const Geometry *canvas_g = &bar->canvas_g;
+    const GraphSamples *graph;
+    GraphSpec spec;
+    int nsamples, nrects = 0;
+    double max;
+
+    if (!graph_spec(blk->tags[Graph]->val, &spec) ||
+        !(graph = graph_get(spec.name)))
+        return;
+    nsamples = spec.width < (int)graph->nsamples ? spec.width
+                                                 : (int)graph->nsamples;
+    max      = spec.max;
+    // scaled to the largest visible sample, if 'max' isn't provided.
+    for (int i = 0; spec.max <= 0 && i < nsamples; ++i)
+        if (graph_sample(graph, i) > max)
+            max = graph_sample(graph, i);
+    if (max <= 0)
         return;
-    if (dpy())
-        close(ConnectionNumber(dpy()));
-    setsid();
 
-    char *words[1 << 6];
-    uint32_t cursor = 0;
-    for (uint32_t i = 0, len = strlen(cmd); i < len;) {
-        for (; i < len && cmd[i] == ' '; ++i)
-            cmd[i] = 0;
-        if (i < len)
-            words[cursor++] = cmd + i;
-        while (i < len && cmd[i] != ' ')
-            ++i;
+    for (int i = 0; i < nsamples; ++i) {
+        double ratio = graph_sample(graph, i) / max;
+        int height   = ratio >= 1 ? (int)canvas_g->h
+                       : ratio > 0 ? (int)(ratio * canvas_g->h + .5)
+                                   : 0;
+        if (height)
+            rects[nrects++] =
+                (XRectangle){.x      = gi->x + gi->width - 1 - i,
+                             .y      = canvas_g->y + canvas_g->h - height,
+                             .width  = 1,
+                             .height = height};
     }
-    words[cursor] = NULL;
+    XftColor *color = strlen(spec.color) ? request_color(spec.color)
+                      : blk->tags[Fg]    ? request_color(blk->tags[Fg]->val)
+                                         : &drw.foreground;
+    for (int i = 0; drw.shm && i < nrects; ++i)
+        raster_fill(&bar->raster, color, rects[i].x, rects[i].y,
+                    rects[i].width, rects[i].height);
+    if (nrects && !drw.shm)
+        XRenderFillRectangles(dpy(), PictOpOver, XftDrawPicture(bar->canvas),
+                              &color->color, rects, nrects);
+}
+
+// a 1px line, centered in the gap (if it has a color).
+static inline void xrender_gap(const Block *blk, const GlyphInfo *gi)
+{
+    char color[32];
+    if (gap_spec(blk->tags[Gap]->val, color) && *color)
+        draw_rect(request_color(color), gi->x + gi->width / 2, bar->canvas_g.y,
+                  1, bar->canvas_g.h);
+}
 
-    execvp((char *)words[0], (char **)words);
-    exit(EXIT_SUCCESS);
+// images taller than the canvas are cropped (vertically centered).
+static inline void xrender_image(const Block *blk, const GlyphInfo *gi)
+{
+    const Geometry *canvas_g = &bar->canvas_g;
+    const ImageCache *img    = request_image(blk->tags[Img]->val, false);
+    int height = img->height < (int)canvas_g->h ? img->height
+                                                : (int)canvas_g->h;
+    if (img->pixels)
+        raster_composite(&bar->raster, img->pixels, img->width, 0,
+                         (img->height - height) / 2, gi->x,
+                         canvas_g->y + (canvas_g->h - height) / 2, img->width,
+                         height);
+    if (img->picture == None)
+        return;
+    XRenderComposite(dpy(), PictOpOver, img->picture, None,
+                     XftDrawPicture(bar->canvas), 0,
+                     (img->height - height) / 2, 0, 0, gi->x,
+                     canvas_g->y + (canvas_g->h - height) / 2, img->width,
+                     height);
+}
+
+static inline void draw_blk(const Block *blk, const GlyphInfo *gi)
+{
+    if (blk->tags[Bg] != NULL)
+        xrender_bg(blk, gi);
+    if (blk->tags[Box] != NULL)
+        xrender_box(blk, gi);
+    if (blk->tags[Graph] != NULL)
+        xrender_graph(blk, gi);
+    else if (blk->tags[Img] != NULL)
+        xrender_image(blk, gi);
+    else if (blk->tags[Gap] != NULL)
+        xrender_gap(blk, gi);
+    else
+        xrender_string(blk, gi);
+}
+
+// draws the channel on the current bar.
+static inline void draw_blks(BlockType blktype)
+{
+    int shift = bar_shift(bar, channel(blktype)->align);
+    for (int i = 0; i < clubar->nblks[blktype]; ++i) {
+        const Block *blk = &clubar->blks[blktype][i];
+        GlyphInfo gi     = drw.gis[blktype][i];
+        gi.x += shift;
+        draw_blk(blk, &gi);
+    }
+}
+
+// re-measures every channel (once), and redraws all the bars.
+static inline void redraw(void)
+{
+    if (!gui_visible())
+        return;
+    for (BlockType blktype = 0; blktype < clubar->config.nchannels; ++blktype)
+        generate_gis(blktype);
+    for (Alignment align = 0; align < NullAlignment; ++align)
+        layout_channels(align);
+    FOR_EACH_BAR
+    {
+        fill_rect(0, 0, bar->window_g.w, bar->window_g.h);
+        for (BlockType b = 0; b < clubar->config.nchannels; ++b)
+            draw_blks(b);
+        bar_present();
+    }
+}
+
+static inline struct Bar *find_bar(Window window)
+{
+    for (int i = 0; i < nbars; ++i)
+        if (bars[i].window == window)
+            return &bars[i];
+    return NULL;
+}
+
+#define MAX_CMD_WORDS (1 << 6)
+
+// 'args' is the (already tokenized) value of an action tag, with '%n' being
+// substituted by 'count'. The X connection is close-on-exec, and 'posix_spawn'
+// doesn't copy the address space (unlike 'fork'), so the latency doesn't grow
+// with the size of the process.
+static void execute_cmd(const char *args, int count)
+{
+    static char buffer[BLK_BUFFER_SIZE << 1];
+    char *words[MAX_CMD_WORDS], n[16];
+    int nwords = 0, nn = snprintf(n, sizeof(n), "%d", count);
+    size_t len = 0;
+    pid_t pid;
+    posix_spawnattr_t attr;
+    sigset_t sig_set;
+
+    for (const char *word = args; *word && nwords < MAX_CMD_WORDS - 1 &&
+                                  len < sizeof(buffer) - 1;
+         word += strlen(word) + 1) {
+        words[nwords++] = buffer + len;
+        for (const char *c = word; *c && len + nn + 1 < sizeof(buffer); ++c) {
+            if (c[0] == '%' && c[1] == 'n')
+                memcpy(buffer + len, n, nn), len += nn, ++c;
+            else
+                buffer[len++] = *c;
+        }
+        buffer[len++] = 0;
+    }
+    words[nwords] = NULL;
+
+    // signals are blocked in every thread (handled by 'sigwait'), the child
+    // mustn't inherit that.
+    sigemptyset(&sig_set);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &sig_set);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_USEVFORK |
+                                        POSIX_SPAWN_SETSIGMASK);
+    PROBE2(exec, words[0], count);
+    STATS_TIMED(StatSpawn)
+    {
+        if ((errno = posix_spawnp(&pid, words[0], NULL, &attr, words,
+                                  environ)) != 0)
+            eprintf("Unable to execute '%s': %s.\n", words[0],
+                    strerror(errno));
+    }
+    posix_spawnattr_destroy(&attr);
+}
+
+// An action using '%n' runs right away, and the identical ones that follow
+// within the coalescing window (e.g. the rest of a scroll wheel flick), are run
+// once the window is over, with '%n' as their count.
+static struct {
+    char cmd[BLK_BUFFER_SIZE];
+    size_t size;
+    int count;
+    bool active;
+    uint64_t deadline;
+} pending = {0};
+
+// Builtin actions (starting with ':') don't spawn anything:
+//   ':desktop N'  switch to (EWMH) desktop N.
+static inline bool builtin_action(const char *args)
+{
+    if (args[0] != ':')
+        return false;
+    if (strcmp(args, ":desktop") == 0) {
+        XEvent e = {.xclient = {.type         = ClientMessage,
+                                .window       = root(),
+                                .message_type = atoms[NetCurrentDesktop],
+                                .format       = 32}};
+        e.xclient.data.l[0] = atol(args + strlen(args) + 1);
+        e.xclient.data.l[1] = CurrentTime;
+        XSendEvent(dpy(), root(), False,
+                   SubstructureNotifyMask | SubstructureRedirectMask, &e);
+        XFlush(dpy());
+    } else
+        eprintf("Unknown action: '%s'.\n", args);
+    return true;
+}
+
+static inline void queue_cmd(const char *args)
+{
+    if (builtin_action(args))
+        return;
+    const char *end = args;
+    uint64_t window = clubar->config.coalesce_ms * 1000000ull;
+    while (*end)
+        end += strlen(end) + 1;
+    size_t size = end - args + 1; // including the terminating (empty) word.
+
+    if (window && pending.active && pending.size == size &&
+        memcmp(pending.cmd, args, size) == 0) {
+        pending.count++;
+        return;
+    }
+    gui_flush_actions(true);
+    execute_cmd(args, 1);
+    if (window && memmem(args, size, "%n", 2)) {
+        memcpy(pending.cmd, args, size);
+        pending.size = size, pending.count = 0, pending.active = true;
+        pending.deadline = stats_now() + window;
+    }
+}
+
+// runs the coalesced action, once its window is over (or right away, if
+// 'force'd).
+void gui_flush_actions(bool force)
+{
+    if (!pending.active || (!force && stats_now() < pending.deadline))
+        return;
+    if (pending.count)
+        execute_cmd(pending.cmd, pending.count);
+    pending.active = false;
 }
 
 bool get_window_name(char *buffer)
@@ -282,12 +878,251 @@ bool get_window_name(char *buffer)
     if (XFetchName(dpy(), root(), &wm_name) && wm_name) {
         strcpy(buffer, wm_name);
         XFree(wm_name);
+        PROBE1(wm_name, buffer);
         return true;
     }
     return false;
 }
 
-void onExpose(void) { fill_rect(0, 0, bar.window_g.w, bar.window_g.h); }
+// (at most 1024 items of) a window property, to be 'XFree'd (NULL if missing).
+static inline void *get_property(Window window, Atom property, Atom type,
+                                 unsigned long *nitems)
+{
+    Atom actual_type;
+    int format;
+    unsigned long after;
+    unsigned char *data = NULL;
+    if (XGetWindowProperty(dpy(), window, property, 0, 1 << 10, False, type,
+                           &actual_type, &format, nitems, &after,
+                           &data) != Success ||
+        actual_type != type || !*nitems) {
+        if (data)
+            XFree(data);
+        return NULL;
+    }
+    return data;
+}
+
+static inline void append(char *buffer, size_t *n, size_t size,
+                          const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int len = *n < size ? vsnprintf(buffer + *n, size - *n, format, args) : 0;
+    va_end(args);
+    *n = len > 0 && *n + len < size ? *n + len : size - 1;
+}
+
+// names (and titles) are shown as text, not as markup (e.g. a title could add
+// actions otherwise), so '<' is replaced with a lookalike.
+static inline void append_text(char *buffer, size_t *n, size_t size,
+                               const char *text, size_t len)
+{
+    for (size_t i = 0; i < len && text[i] && *n + 3 < size; ++i) {
+        if (text[i] == '<')
+            memcpy(buffer + *n, "\xe2\x80\xb9", 3), *n += 3;
+        else
+            buffer[(*n)++] = text[i];
+    }
+    buffer[*n] = 0;
+}
+
+static inline bool has_module(const char *name)
+{
+    for (int i = 0; i < clubar->config.nmodules; ++i)
+        if (strcmp(clubar->config.modules[i].name, name) == 0)
+            return true;
+    return false;
+}
+
+// Every (EWMH) desktop as '<BtnL=:desktop N><Style=workspace> name </Style>
+// </BtnL>', the current one with the 'workspace_current' style.
+static inline void get_workspaces(char *buffer, size_t size)
+{
+    unsigned long ncount, ncurrent, nnames;
+    long *count = get_property(root(), atoms[NetNumberOfDesktops], XA_CARDINAL,
+                               &ncount),
+         *current = get_property(root(), atoms[NetCurrentDesktop],
+                                 XA_CARDINAL, &ncurrent);
+    char *names = get_property(root(), atoms[NetDesktopNames],
+                               atoms[UTF8String], &nnames),
+         *name  = names;
+    size_t n    = 0;
+    char index[24];
+
+    buffer[0] = 0;
+    for (long i = 0; count && i < count[0]; ++i) {
+        append(buffer, &n, size, "<BtnL=:desktop %ld><Style=%s> ", i,
+               current && current[0] == i ? "workspace_current" : "workspace");
+        if (name && name < names + nnames && *name) {
+            append_text(buffer, &n, size, name, names + nnames - name);
+            name += strnlen(name, names + nnames - name) + 1;
+        } else {
+            snprintf(index, sizeof(index), "%ld", i + 1);
+            append_text(buffer, &n, size, index, sizeof(index));
+            name = name ? name + 1 : NULL;
+        }
+        append(buffer, &n, size, " </Style></BtnL>");
+    }
+    if (count)
+        XFree(count);
+    if (current)
+        XFree(current);
+    if (names)
+        XFree(names);
+}
+
+static Window active_window = None;
+// serials of the requests on the active window, [first, last), see 'on_error'.
+static unsigned long active_serials[2] = {0, 0};
+
+// the title ('_NET_WM_NAME', or 'WM_NAME') of the active window, whose title
+// changes are followed as well.
+static inline void query_active_window(char *buffer, size_t size,
+                                       bool changed)
+{
+    unsigned long nitems;
+    size_t n = 0;
+    char *title;
+    if (changed) {
+        Window *window = get_property(root(), atoms[NetActiveWindow],
+                                      XA_WINDOW, &nitems),
+               next    = window ? *window : None;
+        if (window)
+            XFree(window);
+        if (next != active_window) {
+            if (active_window != None)
+                XSelectInput(dpy(), active_window, NoEventMask);
+            if ((active_window = next) != None)
+                XSelectInput(dpy(), active_window, PropertyChangeMask);
+        }
+    }
+    buffer[0] = 0;
+    if (active_window == None)
+        return;
+    if ((title = get_property(active_window, atoms[NetWMName],
+                              atoms[UTF8String], &nitems))) {
+        append_text(buffer, &n, size, title, nitems);
+        XFree(title);
+    } else if (XFetchName(dpy(), active_window, &title) && title) {
+        append_text(buffer, &n, size, title, strlen(title));
+        XFree(title);
+    }
+}
+
+static inline void get_active_window(char *buffer, size_t size, bool changed)
+{
+    active_serials[0] = NextRequest(dpy()), active_serials[1] = ULONG_MAX;
+    query_active_window(buffer, size, changed);
+    // the errors of 'XSelectInput' (async) are in, before the range is closed.
+    if (changed)
+        XSync(dpy(), False);
+    active_serials[1] = NextRequest(dpy());
+}
+
+// Updates the 'workspaces' and 'window' modules ('buffer' holding the latest
+// value of 'module'), only on the (EWMH) properties they're made of, returns
+// whether 'module' needs an update ('xevent' being NULL for the initial one).
+bool onEwmhChange(const XEvent *xevent, const char *module, char *buffer,
+                  size_t size)
+{
+    const XPropertyEvent *e = xevent ? &xevent->xproperty : NULL;
+    if (!has_module(module))
+        return false;
+    if (strcmp(module, "workspaces") == 0) {
+        if (e && (e->window != root() ||
+                  (e->atom != atoms[NetNumberOfDesktops] &&
+                   e->atom != atoms[NetCurrentDesktop] &&
+                   e->atom != atoms[NetDesktopNames])))
+            return false;
+        get_workspaces(buffer, size);
+        return true;
+    }
+    bool root_changed = !e || (e->window == root() &&
+                               e->atom == atoms[NetActiveWindow]);
+    if (!root_changed &&
+        (e->window != active_window || active_window == None ||
+         (e->atom != atoms[NetWMName] && e->atom != XA_WM_NAME)))
+        return false;
+    get_active_window(buffer, size, root_changed);
+    return true;
+}
+
+// the active window could be gone (by the time it's queried), any other error
+// (e.g. a BadWindow on the bars) is handled as usual.
+static int (*default_error_handler)(Display *, XErrorEvent *) = NULL;
+static int on_error(Display *display, XErrorEvent *e)
+{
+    bool on_active_window = e->error_code == BadWindow &&
+                            e->serial >= active_serials[0] &&
+                            e->serial < active_serials[1];
+    // a failed MIT-SHM attach is a fallback to XRender (see 'raster_create').
+    if (on_active_window || raster_on_error(e))
+        return 0;
+    return default_error_handler(display, e);
+}
+
+// Only the exposed bar is redrawn (the blocks are already measured), the
+// raster already holds the frame, and just presents it again.
+void onExpose(const XEvent *xevent)
+{
+    if (xevent->xexpose.count || !(bar = find_bar(xevent->xexpose.window)))
+        return;
+    if (drw.shm) {
+        raster_damage_all(&bar->raster);
+    } else {
+        fill_rect(0, 0, bar->window_g.w, bar->window_g.h);
+        for (BlockType b = 0; b < clubar->config.nchannels; ++b)
+            draw_blks(b);
+    }
+    bar_present();
+}
+
+// Frames presented with MIT-SHM (see 'raster_wait'), 'gui_mutex' isn't needed
+// (nor taken, as the drawing thread might be waiting on this very event).
+bool onShmCompletion(const XEvent *xevent)
+{
+    for (int i = 0; drw.shm && i < MAX_BARS; ++i)
+        if (raster_complete(&bars[i].raster, xevent))
+            return true;
+    return false;
+}
+
+// outputs were added/removed/resized.
+void onScreenChange(const XEvent *xevent)
+{
+#ifdef __ENABLE_RANDR__
+    if (randr_event_base < 0 ||
+        xevent->type != randr_event_base + RRScreenChangeNotify)
+        return;
+    XRRUpdateConfiguration((XEvent *)xevent);
+    bars_update(&clubar->config, 0x0);
+    redraw();
+#else
+    (void)xevent;
+#endif
+}
+
+// Tracks whether any of the bars can be seen (mapped and not fully obscured),
+// returns true if the bars just became visible (after being hidden).
+bool onVisibilityChange(const XEvent *xevent)
+{
+    struct Bar *b    = find_bar(xevent->xany.window);
+    bool was_visible = gui_visible();
+    if (!b)
+        return false;
+    switch (xevent->type) {
+    case MapNotify: b->mapped = true; break;
+    case UnmapNotify: b->mapped = false; break;
+    case VisibilityNotify: {
+        b->obscured = xevent->xvisibility.state == VisibilityFullyObscured;
+    } break;
+    default: break;
+    }
+    if (was_visible && !gui_visible() && clubar->config.cache_floor_kb >= 0)
+        images_trim((size_t)clubar->config.cache_floor_kb << 10);
+    return !was_visible && gui_visible();
+}
 
 void onMapNotify(const XEvent *xevent, char *name)
 {
@@ -309,17 +1144,20 @@ void onButtonPress(const XEvent *xevent)
     const XButtonEvent *e     = &xevent->xbutton;
     TagName tag_name          = NullTagName;
     TagModifierMask tmod_mask = 0x0;
-    for (int i = 0; i < clubar->nblks[Stdin] + clubar->nblks[Custom]; ++i) {
-        const Block *blk =
-            i < clubar->nblks[Stdin]
-                ? &clubar->blks[Stdin][i]
-                : &clubar->blks[Custom][i - clubar->nblks[Stdin]];
-        const GlyphInfo *gi = i < clubar->nblks[Stdin]
-                                  ? &drw.gis[Stdin][i]
-                                  : &drw.gis[Custom][i - clubar->nblks[Stdin]];
-        // check if click event coordinates match with any coordinate on the bar
-        // window.
-        if (e->x >= gi->x && e->x <= gi->x + gi->width) {
+    // not the 'bar' cursor, that one is for the drawing threads ('gui_mutex').
+    const struct Bar *b = find_bar(e->window);
+    if (!b)
+        return;
+    for (BlockType blktype = 0; blktype < clubar->config.nchannels; ++blktype) {
+        // click coordinates, relative to where the channel was laid out.
+        int x = e->x - bar_shift(b, channel(blktype)->align);
+        for (int i = 0; i < clubar->nblks[blktype]; ++i) {
+            const Block *blk    = &clubar->blks[blktype][i];
+            const GlyphInfo *gi = &drw.gis[blktype][i];
+            // check if click event coordinates match with any coordinate on
+            // the bar window.
+            if (x < gi->x || x > gi->x + gi->width)
+                continue;
 
             switch (e->button) {
             case Button1: tag_name = BtnL; break;
@@ -340,92 +1178,187 @@ void onButtonPress(const XEvent *xevent)
             if (e->state & Mod4Mask)
                 tmod_mask |= (1 << Alt);
 
+            // i3bar blocks are clicked by the producer (not by tags).
+            if (blktype == Stdin && clubar->config.i3bar) {
+                I3BarClick click = {
+                    .button = e->button,     .modifiers = tmod_mask,
+                    .x = e->x_root,          .y = e->y_root,
+                    .relative_x = x - gi->x, .relative_y = e->y,
+                    .width = gi->width,      .height = b->window_g.h,
+                };
+                i3bar_click(i, &click);
+                return;
+            }
             if (tag_name != NullTagName)
                 for (Tag *tag = blk->tags[tag_name]; tag; tag = tag->previous)
                     if (strlen(tag->val) && tag->tmod_mask == tmod_mask)
-                        execute_cmd(tag->val);
-            break;
+                        queue_cmd(tag->val);
+            return;
         }
     }
 }
 
 void gui_init(void)
 {
-    for (int i = 0; i < MAX_BLKS; ++i)
-        drw.gis[Stdin][i] = drw.gis[Custom][i] = (GlyphInfo){0, 0};
+    for (BlockType blktype = 0; blktype < MAX_CHANNELS; ++blktype) {
+        drw.regions[blktype] = (GlyphInfo){0, 0};
+        for (int i = 0; i < MAX_BLKS; ++i)
+            drw.gis[blktype][i] = (GlyphInfo){0, 0};
+    }
     if ((dpy() = XOpenDisplay(NULL)) == NULL)
         die("Cannot open display.\n");
+    fcntl(ConnectionNumber(dpy()), F_SETFD, FD_CLOEXEC);
+    default_error_handler = XSetErrorHandler(on_error);
+
+    // a single round trip, for all of them.
+    char *atom_names[NullWMAtom] = {
+        [WMName]              = "WM_NAME",
+        [NetWMWindowType]     = "_NET_WM_WINDOW_TYPE",
+        [NetWMDock]           = "_NET_WM_WINDOW_TYPE_DOCK",
+        [NetWMStrut]          = "_NET_WM_STRUT",
+        [NetWMName]           = "_NET_WM_NAME",
+        [NetNumberOfDesktops] = "_NET_NUMBER_OF_DESKTOPS",
+        [NetCurrentDesktop]   = "_NET_CURRENT_DESKTOP",
+        [NetDesktopNames]     = "_NET_DESKTOP_NAMES",
+        [NetActiveWindow]     = "_NET_ACTIVE_WINDOW",
+        [UTF8String]          = "UTF8_STRING",
+    };
+    XInternAtoms(dpy(), atom_names, NullWMAtom, False, atoms);
 
-    atoms[WMName]          = XInternAtom(dpy(), "WM_NAME", False);
-    atoms[NetWMDock]       = XInternAtom(dpy(), "_NET_WM_WINDOW_TYPE_DOCK", 0);
-    atoms[NetWMStrut]      = XInternAtom(dpy(), "_NET_WM_STRUT", 0);
-    atoms[NetWMWindowType] = XInternAtom(dpy(), "_NET_WM_WINDOW_TYPE", 0);
+#ifdef __ENABLE_RANDR__
+    int randr_error_base;
+    if (XRRQueryExtension(dpy(), &randr_event_base, &randr_error_base))
+        XRRSelectInput(dpy(), root(), RRScreenChangeNotifyMask);
+    else
+        randr_event_base = -1;
+#endif
 }
 
 void gui_load(void)
 {
+    if (clubar->config.shm && !(drw.shm = raster_init()))
+        eprintf("MIT-SHM unavailable, falling back to XRender.\n");
     drw_init(&clubar->config);
-    bar_init(&clubar->config);
-    fill_rect(0, 0, bar.window_g.w, bar.window_g.h);
+    colors_init(&clubar->config);
+    bars_update(&clubar->config, ALL_CONFIG_CHANGES);
+    FOR_EACH_BAR
+    {
+        fill_rect(0, 0, bar->window_g.w, bar->window_g.h);
+        bar_present();
+    }
+}
 
-    XStoreName(dpy(), bar.window, NAME);
-    XSetClassHint(dpy(), bar.window,
-                  &(XClassHint){.res_name = NAME, .res_class = NAME});
+// Applies only what a config reload changed, the bars are redrawn only if the
+// changes are visible on the canvas (cached blocks are drawn as is).
+void gui_reload(ConfigChanges changes)
+{
+    if (CHANGED(changes, ChangedFonts))
+        drw_init(&clubar->config);
+    if (CHANGED(changes, ChangedColors))
+        colors_init(&clubar->config);
+    bars_update(&clubar->config, changes);
+    if (CHANGED(changes, ChangedFonts) || CHANGED(changes, ChangedColors) ||
+        CHANGED(changes, ChangedGeometry))
+        redraw();
+}
 
-    XMapWindow(dpy(), bar.window);
+bool gui_visible(void)
+{
+    for (int i = 0; i < nbars; ++i)
+        if (bars[i].mapped && !bars[i].obscured)
+            return true;
+    return false;
 }
 
+void gui_redraw(void) { redraw(); }
+
 void gui_toggle(void)
 {
     XWindowAttributes attrs;
-    XGetWindowAttributes(dpy(), bar.window, &attrs);
-    attrs.map_state == IsUnmapped ? XMapWindow(dpy(), bar.window)
-                                  : XUnmapWindow(dpy(), bar.window);
+    XGetWindowAttributes(dpy(), bars[0].window, &attrs);
+    FOR_EACH_BAR
+    {
+        attrs.map_state == IsUnmapped ? XMapWindow(dpy(), bar->window)
+                                      : XUnmapWindow(dpy(), bar->window);
+    }
 }
 
+// nothing is drawn (or measured) while hidden, 'gui_redraw' catches up.
 void gui_clear(BlockType blktype)
 {
-    if (clubar->nblks[blktype]) {
-        GlyphInfo *first = &drw.gis[blktype][0],
-                  *last  = &drw.gis[blktype][clubar->nblks[blktype] - 1];
-        fill_rect(first->x, 0, last->x + last->width, bar.window_g.h);
+    if (!gui_visible())
+        return;
+    FOR_EACH_BAR
+    {
+        for (BlockType b = 0; b < clubar->config.nchannels; ++b)
+            if (is_dependent(b, blktype) && drw.regions[b].width)
+                fill_rect(drw.regions[b].x + bar_shift(bar, channel(b)->align),
+                          0, drw.regions[b].width, bar->window_g.h);
     }
 }
 
+// Only the updated channel is re-measured, the channels that might have been
+// moved by it, are just redrawn.
 void gui_draw(BlockType blktype)
 {
-    switch (blktype) {
-    case Stdin: {
-        generate_stdin_gis();
-    } break;
-    case Custom: {
-        generate_custom_gis();
-    } break;
+    if (!gui_visible())
+        return;
+    uint64_t start = stats_now();
+    PROBE1(draw_start, blktype);
+    generate_gis(blktype);
+    layout_channels(channel(blktype)->align);
+    FOR_EACH_BAR
+    {
+        for (BlockType b = 0; b < clubar->config.nchannels; ++b)
+            if (is_dependent(b, blktype))
+                draw_blks(b);
+        bar_present();
     }
-    for (int i = 0; i < clubar->nblks[blktype]; ++i) {
-        const Block *blk    = &clubar->blks[blktype][i];
-        const GlyphInfo *gi = &drw.gis[blktype][i];
+    PROBE1(draw_end, blktype);
+    stats_time(StatDraw, stats_now() - start);
+}
 
-        if (blk->tags[Bg] != NULL)
-            xrender_bg(blk, gi);
-        if (blk->tags[Box] != NULL)
-            xrender_box(blk, gi);
-        xrender_string(blk, gi);
+// A new sample only changes the graph itself, so only the blocks drawing the
+// graph are redrawn (nothing is re-parsed or re-measured).
+void gui_draw_graph(const char *name)
+{
+    if (!gui_visible())
+        return;
+    uint64_t start = stats_now();
+    GraphSpec spec;
+    FOR_EACH_BAR
+    {
+        for (BlockType b = 0; b < clubar->config.nchannels; ++b) {
+            int shift = bar_shift(bar, channel(b)->align);
+            for (int i = 0; i < clubar->nblks[b]; ++i) {
+                const Block *blk = &clubar->blks[b][i];
+                GlyphInfo gi     = drw.gis[b][i];
+                if (!blk->tags[Graph] ||
+                    !graph_spec(blk->tags[Graph]->val, &spec) ||
+                    strcmp(spec.name, name) != 0)
+                    continue;
+                gi.x += shift;
+                fill_rect(gi.x, 0, gi.width, bar->window_g.h);
+                draw_blk(blk, &gi);
+            }
+        }
+        bar_present();
     }
+    stats_time(StatDraw, stats_now() - start);
 }
 
 void gui_destroy(void)
 {
     while (drw.colorcache)
         CC_FREE(drw.colorcache);
+    while (drw.imagecache)
+        image_evict(drw.imagecache);
 
-    for (int i = 0; i < drw.nfonts; ++i)
-        XftFontClose(dpy(), drw.fonts[i]);
-    if (drw.fonts)
-        free(drw.fonts);
+    drw_free_fonts();
 
-    XftColorFree(dpy(), vis(), cmap(), &bar.foreground);
-    XftColorFree(dpy(), vis(), cmap(), &bar.background);
-    XftDrawDestroy(bar.canvas);
+    XftColorFree(dpy(), vis(), cmap(), &drw.foreground);
+    XftColorFree(dpy(), vis(), cmap(), &drw.background);
+    while (nbars)
+        bar_destroy(&bars[--nbars]);
     XCloseDisplay(dpy());
 }
@@ -13,16 +13,25 @@ extern Display *_dpy;
 #define vis()  (DefaultVisual(dpy(), scr()))
 #define cmap() (DefaultColormap(dpy(), scr()))
 
-void onExpose(void);
+void onExpose(const XEvent *);
+bool onShmCompletion(const XEvent *);
+void onScreenChange(const XEvent *);
+bool onVisibilityChange(const XEvent *);
 void onMapNotify(const XEvent *, char *);
 bool onPropertyNotify(const XEvent *, char *);
+bool onEwmhChange(const XEvent *, const char *, char *, size_t);
 void onButtonPress(const XEvent *);
 
 void gui_init(void);
 void gui_load(void);
+void gui_reload(ConfigChanges);
+bool gui_visible(void);
+void gui_redraw(void);
 void gui_toggle(void);
 void gui_clear(BlockType);
 void gui_draw(BlockType);
+void gui_draw_graph(const char *);
+void gui_flush_actions(bool);
 void gui_destroy(void);
 
 #endif
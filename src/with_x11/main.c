@@ -1,11 +1,33 @@
 #include "gui.h"
 #include <clubar.h>
 #include <clubar/blocks.h>
+#include <clubar/graphs.h>
+#include <clubar/i3bar.h>
+#include <clubar/ipc.h>
+#include <clubar/loader.h>
+#include <clubar/modules.h>
+#include <clubar/probes.h>
+#include <clubar/replay.h>
+#include <clubar/ring.h>
+#include <clubar/sched.h>
+#include <clubar/stats.h>
+#include <clubar/watch.h>
+#ifdef __ENABLE_PLUGIN__luaconfig__
+#include <clubar/plugins/luaconfig.h>
+#endif
+#ifdef __ENABLE_PLUGIN__xrmconfig__
+#include <X11/Xatom.h>
+#include <clubar/plugins/xrmconfig.h>
+#endif
+#include <fcntl.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/poll.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -26,10 +48,10 @@ typedef struct ThreadSync {
 #define THREADSYNC_WAIT(t)                                                     \
     MUTEX_GUARD(&t.mutex) if (!t.ready) pthread_cond_wait(&t.cond, &t.mutex);
 #define THREADSYNC_SIGNAL(t)                                                   \
-    MUTEX_GUARD(&t.mutex) { t.ready = true; pthread_cond_signal(&t.cond); }
+    MUTEX_GUARD(&t.mutex) { t.ready = true; pthread_cond_broadcast(&t.cond); }
 // clang-format on
 
-static ThreadSync stdin_threadsync    = THREADSYNC();
+static ThreadSync gui_threadsync    = THREADSYNC();
 static pthread_rwlock_t clubar_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 static pthread_mutex_t gui_mutex      = PTHREAD_MUTEX_INITIALIZER;
 static const struct timespec ts       = {.tv_nsec = 1e6 * (1000 / 120.)};
@@ -45,60 +67,279 @@ static const struct timespec ts       = {.tv_nsec = 1e6 * (1000 / 120.)};
     for (int _c = (pthread_mutex_lock(&gui_mutex), gui_clear(blktype), 1); _c; \
          _c     = (gui_draw(blktype), pthread_mutex_unlock(&gui_mutex), 0))
 
+// while the bar is hidden, only the newest line (of a channel) is kept.
+static void publish(BlockType blktype, const char *line)
+{
+    CLEAR_AND_RENDER_WITH(blktype)
+    {
+        if (gui_visible()) {
+            CLUBAR_WRGUARD { clubar_update_blks(clubar, blktype, line); }
+        } else
+            CLUBAR_WRGUARD { clubar_defer_blks(clubar, blktype, line); }
+    }
+}
+
+// i3bar status lines only make it into blocks while the bar is visible (the
+// latest one is kept meanwhile).
+static void publish_i3bar(BlockType blktype)
+{
+    CLEAR_AND_RENDER_WITH(blktype)
+    {
+        if (gui_visible())
+            CLUBAR_WRGUARD { clubar_update_i3bar(clubar, blktype); }
+    }
+}
+
+// the deferred lines are parsed (and drawn) at once, as the bar shows up.
+static void on_visibility_change(const XEvent *e)
+{
+    MUTEX_GUARD(&gui_mutex)
+    {
+        if (onVisibilityChange(e)) {
+            CLUBAR_WRGUARD { clubar_flush_deferred(clubar); }
+            gui_redraw();
+        }
+    }
+}
+
+static void publish_segment(BlockType blktype, const char *name,
+                            const char *line)
+{
+    CLEAR_AND_RENDER_WITH(blktype)
+    {
+        CLUBAR_WRGUARD { clubar_update_segment(clubar, blktype, name, line); }
+    }
+}
+
+static void publish_fill(BlockType blktype, const char *name, const char *var,
+                         const char *value)
+{
+    CLEAR_AND_RENDER_WITH(blktype)
+    {
+        CLUBAR_WRGUARD
+        {
+            clubar_fill_segment(clubar, blktype, name, var, value);
+        }
+    }
+}
+
+// samples are only ever read while drawing (under 'gui_mutex').
+static void publish_sample(const char *graph, double value)
+{
+    MUTEX_GUARD(&gui_mutex)
+    {
+        if (graph_push(graph, value)) {
+            gui_draw_graph(graph);
+        } else
+            eprintf("Unable to create graph: '%s'.\n", graph);
+    }
+}
+
+// The (EWMH) 'workspaces' and 'window' modules are fed straight from the X
+// events, and only when the properties they're made of change ('e' being NULL
+// for the initial values).
+static void publish_ewmh(const XEvent *e)
+{
+    static const char *const ewmh_modules[] = {"workspaces", "window"};
+    static char value[BLK_BUFFER_SIZE];
+    for (size_t i = 0; i < sizeof(ewmh_modules) / sizeof(*ewmh_modules); ++i) {
+        bool changed = false;
+        MUTEX_GUARD(&gui_mutex)
+        {
+            changed = onEwmhChange(e, ewmh_modules[i], value, sizeof(value));
+        }
+        if (changed)
+            modules_set(ewmh_modules[i], value);
+    }
+}
+
+// lines longer than this are dropped, so that e.g. 'clubar </dev/zero' doesn't
+// eat up all the memory.
+#define MAX_LINE_SIZE (1 << 20)
+
 typedef struct LineReader {
-    char buffer[4096];
-    int start, end;
+    char *buffer;
+    int fd;
+    size_t start, end, capacity; // 'start': beginning of the incomplete line.
+    bool discarding; // the rest of a dropped line (up to its newline).
 } LineReader;
-#define LINE_READER() (LineReader){.start = 0, .end = 0};
+#define LINE_READER(source_fd) ((LineReader){.buffer = NULL, .fd = (source_fd)})
 
-static inline char *readline(LineReader *lr)
+// Drains everything available (in a single read), and returns only the newest
+// complete line (NULL if there isn't one), the older ones are stale anyway, and
+// are just counted (as dropped) and recorded (with '--record').
+static inline char *readline(LineReader *lr, const char *channel)
 {
-    static const int size = sizeof(lr->buffer) - 1;
-    if (lr->start > 0 && lr->buffer[lr->start - 1] == 0) {
+    int available;
+    size_t size;
+    ssize_t n;
+    char *last, *line, *newline;
+
+    if (lr->start > 0) {
         memmove(lr->buffer, lr->buffer + lr->start, lr->end -= lr->start);
         lr->start = 0;
     }
-    if (lr->start == lr->end) {
-        if (lr->end == size)
-            lr->start = lr->end = 0;
-        ssize_t n;
-        if ((n = read(STDIN_FILENO, lr->buffer + lr->end, size - lr->end)) > 0)
-            lr->end += n;
-    }
-    for (; lr->start < lr->end; ++lr->start)
-        if (lr->buffer[lr->start] == '\n' && !(lr->buffer[lr->start++] = 0))
-            return lr->buffer;
-    return NULL;
+    if (ioctl(lr->fd, FIONREAD, &available) < 0 || available <= 0)
+        available = BLK_BUFFER_SIZE;
+    available = available < MAX_LINE_SIZE ? available : MAX_LINE_SIZE;
+    if (lr->end + available > MAX_LINE_SIZE) {
+        stats_count(StatLineDropped);
+        lr->end = 0, lr->discarding = true;
+    }
+    if ((size = lr->end + available + 1) > lr->capacity) {
+        size = lr->capacity ? lr->capacity : BLK_BUFFER_SIZE;
+        while (size < lr->end + available + 1)
+            size <<= 1;
+        if (!(line = realloc(lr->buffer, size)))
+            die("realloc(): Unable to grow line buffer.\n");
+        lr->buffer = line, lr->capacity = size;
+    }
+    if ((n = read(lr->fd, lr->buffer + lr->end, available)) <= 0)
+        return NULL;
+    lr->end += n;
+    if (lr->discarding) {
+        // nothing but the rest of the dropped line is buffered.
+        if (!(newline = memchr(lr->buffer, '\n', lr->end)))
+            return (lr->end = 0), NULL;
+        n = lr->end -= newline + 1 - lr->buffer;
+        memmove(lr->buffer, newline + 1, lr->end);
+        lr->discarding = false;
+    }
+
+    // only the newly read bytes can have newlines.
+    if (!(last = memrchr(lr->buffer + lr->end - n, '\n', n)))
+        return NULL;
+    *last     = 0;
+    lr->start = last + 1 - lr->buffer;
+    for (line = lr->buffer;
+         (newline = memchr(line, '\n', last - line)); line = newline + 1) {
+        stats_count(StatLineDropped);
+        if ((*newline = 0, *line))
+            record_write(channel, line);
+    }
+    return line;
 }
 
-static void *stdin_thread_handler(__attribute__((unused)) void *_)
+// source is either an fd number, or path to a fifo (created if missing).
+static inline int open_source(const char *source)
 {
-    THREADSYNC_WAIT(stdin_threadsync);
-    struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
-    LineReader reader = LINE_READER();
-    char *line;
+    char *end;
+    long fd = strtol(source, &end, 10);
+    if (end != source && *end == 0)
+        return fd;
+    if (access(source, F_OK) != 0 && mkfifo(source, 0600) != 0)
+        return -1;
+    // opened for writing as well, so that the fifo doesn't hang up, when the
+    // (current) writer closes its end.
+    return open(source, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+}
+
+static void *input_thread_handler(__attribute__((unused)) void *_)
+{
+    THREADSYNC_WAIT(gui_threadsync);
+    static LineReader readers[MAX_CHANNELS];
+    struct pollfd pfds[MAX_CHANNELS];
+    BlockType blktypes[MAX_CHANNELS];
+    const char *names[MAX_CHANNELS];
+    int npfds = 0, fd;
+    char *line, chunk[1 << 12];
+    ssize_t nchunk;
+    bool i3bar = clubar->config.i3bar;
+
+    for (BlockType b = 0; b < clubar->config.nchannels; ++b) {
+        const char *source = clubar->config.channels[b].source;
+        // ring buffer channels are consumed by the scheduler.
+        if (!strlen(source) || strcmp(source, RINGBUF_SOURCE) == 0)
+            continue;
+        if ((fd = open_source(source)) < 0) {
+            eprintf("Unable to open source for channel '%s': '%s'.\n",
+                    clubar->config.channels[b].name, source);
+            continue;
+        }
+        readers[npfds]  = LINE_READER(fd);
+        blktypes[npfds] = b;
+        names[npfds]    = clubar->config.channels[b].name;
+        pfds[npfds++]   = (struct pollfd){.fd = fd, .events = POLLIN};
+    }
 
     for (bool running = RUNNING; running;) {
-        if (poll(&pfd, 1, 420) > 0) {
-            if (IS_SET(pfd.revents, POLLERR | POLLHUP)) {
-                CLUBAR_WRGUARD { RUNNING = false; }
-            }
-            if (IS_SET(pfd.revents, POLLIN)) {
-                if ((line = readline(&reader)) == NULL) {
-                    nanosleep(&ts, NULL); // clubar </dev/zero
-                } else if (*line) {
-                    CLEAR_AND_RENDER_WITH(Stdin)
-                    {
-                        CLUBAR_WRGUARD
-                        {
-                            clubar_update_blks(clubar, Stdin, line);
-                        }
+        if (poll(pfds, npfds, 420) > 0) {
+            for (int i = 0; i < npfds; ++i) {
+                if (IS_SET(pfds[i].revents, POLLIN)) {
+                    // the i3bar stream is parsed as bytes arrive (not by
+                    // line).
+                    if (i3bar && blktypes[i] == Stdin) {
+                        nchunk = read(pfds[i].fd, chunk, sizeof(chunk));
+                        if (nchunk <= 0)
+                            nanosleep(&ts, NULL);
+                        else if (i3bar_feed(chunk, nchunk))
+                            publish_i3bar(blktypes[i]);
+                    } else if ((line = readline(&readers[i], names[i])) ==
+                               NULL) {
+                        nanosleep(&ts, NULL); // clubar </dev/zero
+                    } else if (*line) {
+                        PROBE2(line, blktypes[i], line);
+                        publish(blktypes[i], line);
                     }
                 }
+                // stdin closing is the cue to exit, any other channel is
+                // just ignored from now on.
+                if (IS_SET(pfds[i].revents, POLLERR | POLLHUP)) {
+                    if (blktypes[i] == Stdin)
+                        CLUBAR_WRGUARD { RUNNING = false; }
+                    pfds[i].fd = -1;
+                }
             }
         }
         CLUBAR_RDGUARD { running = RUNNING; }
     }
+    for (int i = 0; i < npfds; ++i)
+        free(readers[i].buffer);
+    pthread_exit(0);
+}
+
+static void *replay_thread_handler(__attribute__((unused)) void *_)
+{
+    THREADSYNC_WAIT(gui_threadsync);
+    Replay replay = {0};
+    BlockType blktype;
+    char channel[32], line[BLK_BUFFER_SIZE];
+    uint64_t nevents = 0, start = stats_now();
+
+    if (!replay_open(&replay, clubar->config.replay_file,
+                     clubar->config.replay_speed))
+        die("Unable to open replay file: '%s'.\n", clubar->config.replay_file);
+    for (bool running = RUNNING; running && replay_next(&replay, channel,
+                                                        line, sizeof(line));
+         ++nevents) {
+        if ((blktype = clubar_channel(clubar, channel)) >= 0)
+            publish(blktype, line);
+        else
+            eprintf("Skipping event for unknown channel: '%s'.\n", channel);
+        CLUBAR_RDGUARD { running = RUNNING; }
+    }
+    replay_close(&replay);
+
+    double elapsed = (stats_now() - start) / 1e9;
+    eprintf("replay: %lu events in %.3fs (%.1f events/s).\n", nevents, elapsed,
+            nevents / (elapsed > 0 ? elapsed : 1));
+    // benchmark runs shouldn't linger around, after the input is exhausted.
+    if (clubar->config.replay_speed == 0)
+        CLUBAR_WRGUARD { RUNNING = false; }
+    pthread_exit(0);
+}
+
+// config file changes go through the same (signal driven) reload, as
+// reloading isn't safe from the scheduler thread.
+static void reload(__attribute__((unused)) void *_) { kill(getpid(), SIGUSR2); }
+
+static void *sched_thread_handler(__attribute__((unused)) void *_)
+{
+    THREADSYNC_WAIT(gui_threadsync);
+    for (bool running = RUNNING; running;) {
+        sched_poll(420);
+        CLUBAR_RDGUARD { running = RUNNING; }
+    }
     pthread_exit(0);
 }
 
@@ -121,8 +362,16 @@ static void *sig_thread_handler(void *arg)
             MUTEX_GUARD(&gui_mutex) { gui_toggle(); }
         } break;
         case SIGUSR2: {
-            CLUBAR_WRGUARD { clubar_load_external_configs(clubar); }
-            MUTEX_GUARD(&gui_mutex) { gui_load(); }
+            // the memoized layouts are dropped by the reload (not mid-draw).
+            MUTEX_GUARD(&gui_mutex)
+            {
+                ConfigChanges changes = 0x0;
+                CLUBAR_WRGUARD
+                {
+                    changes = clubar_load_external_configs(clubar);
+                }
+                gui_reload(changes);
+            }
         } break;
         default: break;
         }
@@ -133,7 +382,9 @@ static void *sig_thread_handler(void *arg)
 
 int main(int argc, char const **argv)
 {
-    pthread_t stdin_thread, sig_thread;
+    pthread_t input_thread, sched_thread, sig_thread;
+    bool replaying, first_frame = false;
+    uint64_t process_start = stats_process_start();
     char buffer[BLK_BUFFER_SIZE];
     XEvent e;
     sigset_t sig_set;
@@ -143,6 +394,10 @@ int main(int argc, char const **argv)
 
     clubar_init(clubar);
     gui_init();
+#ifdef __ENABLE_PLUGIN__xrmconfig__
+    xrmconfig_init(dpy());
+#endif
+    replaying = strlen(clubar->config.replay_file) > 0;
 
     {
         sigemptyset(&sig_set);
@@ -157,47 +412,99 @@ int main(int argc, char const **argv)
     }
 
     // spawn thread and wait (for the window to load).
-    pthread_create(&stdin_thread, NULL, stdin_thread_handler, NULL);
+    // while replaying, the recorded session is the only source of input.
+    pthread_create(&input_thread, NULL,
+                   replaying ? replay_thread_handler : input_thread_handler,
+                   NULL);
+    pthread_create(&sched_thread, NULL, sched_thread_handler, NULL);
     pthread_create(&sig_thread, NULL, sig_thread_handler, (void *)&sig_set);
 
     clubar_load_external_configs(clubar);
     gui_load();
+    if (!replaying) {
+        modules_init(&clubar->config, publish);
+        if (strlen(clubar->config.plugin_dir) &&
+            !loader_init(clubar->config.plugin_dir, clubar, publish,
+                         publish_segment))
+            eprintf("Unable to load plugins from: '%s'.\n",
+                    clubar->config.plugin_dir);
+#ifdef __ENABLE_PLUGIN__luaconfig__
+        luaconfig_start(publish_segment);
+#endif
+        for (BlockType b = 0; b < clubar->config.nchannels; ++b) {
+            const ChannelSpec *spec = &clubar->config.channels[b];
+            if (strcmp(spec->source, RINGBUF_SOURCE) == 0 &&
+                !ring_create(spec->name, b, publish))
+                eprintf("Unable to create ring buffer for channel '%s'.\n",
+                        spec->name);
+        }
+        if (strlen(clubar->config.config_file) &&
+            !watch_file(clubar->config.config_file, reload, NULL))
+            eprintf("Unable to watch config file: '%s'.\n",
+                    clubar->config.config_file);
+        if (strlen(clubar->config.socket_file) &&
+            !ipc_init(clubar->config.socket_file, publish_segment,
+                      publish_sample, publish_fill))
+            eprintf("Unable to listen on socket: '%s'.\n",
+                    clubar->config.socket_file);
+    }
 
     for (bool running = RUNNING; running; (void)nanosleep(&ts, NULL)) {
         if (XPending(dpy())) {
             switch (XNextEvent(dpy(), &e), e.type) {
             case Expose: {
-                onExpose();
-                CLEAR_AND_RENDER_WITH(Custom) { (void)0; }
-                CLEAR_AND_RENDER_WITH(Stdin) { (void)0; }
+                MUTEX_GUARD(&gui_mutex) { onExpose(&e); }
+                // process start => first frame (on a mapped window).
+                if (!first_frame && (first_frame = true) && process_start)
+                    stats_time(StatFirstFrame, stats_now() - process_start);
             } break;
             case MapNotify: {
                 onMapNotify(&e, buffer);
-                THREADSYNC_SIGNAL(stdin_threadsync);
+                if (!replaying)
+                    publish_ewmh(NULL);
+                on_visibility_change(&e);
+                THREADSYNC_SIGNAL(gui_threadsync);
+            } break;
+            case UnmapNotify:
+            case VisibilityNotify: {
+                on_visibility_change(&e);
             } break;
             // root window events.
             case PropertyNotify: {
-                if (onPropertyNotify(&e, buffer)) {
-                    CLEAR_AND_RENDER_WITH(Custom)
-                    {
-                        CLUBAR_WRGUARD
-                        {
-                            clubar_update_blks(clubar, Custom, buffer);
-                        }
-                    }
-                }
+                if (onPropertyNotify(&e, buffer) && !replaying)
+                    publish(Custom, buffer);
+                if (!replaying)
+                    publish_ewmh(&e);
+#ifdef __ENABLE_PLUGIN__xrmconfig__
+                // e.g. 'xrdb -merge', reloaded only if it concerns clubar.
+                if (e.xproperty.atom == XA_RESOURCE_MANAGER &&
+                    xrmconfig_update())
+                    kill(getpid(), SIGUSR2);
+#endif
             } break;
             case ButtonPress: {
                 onButtonPress(&e);
             } break;
+            default: {
+                if (onShmCompletion(&e))
+                    break;
+                MUTEX_GUARD(&gui_mutex) { onScreenChange(&e); }
+            } break;
             }
         }
+        gui_flush_actions(false);
         CLUBAR_RDGUARD { running = RUNNING; }
     }
 
-    pthread_join(stdin_thread, NULL);
+    pthread_join(input_thread, NULL);
+    pthread_join(sched_thread, NULL);
+    // 'sig_thread' is blocked in 'sigwait', if the exit wasn't signal driven.
+    pthread_kill(sig_thread, SIGTERM);
     pthread_join(sig_thread, NULL);
+    loader_close();
+    ipc_close();
     gui_destroy();
+    clubar_destroy(clubar);
 
     return 0;
 }
@@ -0,0 +1,351 @@
+#include "raster.h"
+#include "gui.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <time.h>
+
+// coverage of a glyph (0-255 per pixel), rendered once per font.
+typedef struct CachedGlyph {
+    const XftFont *font;
+    FT_UInt index;
+    int left, top, width, height, advance;
+    uint8_t *coverage;
+    struct CachedGlyph *next;
+} CachedGlyph;
+
+#define GLYPH_BUCKETS (1 << 9)
+#define MAX_GLYPHS    (1 << 12) // the whole cache is dropped, once full.
+
+static CachedGlyph *glyphs[GLYPH_BUCKETS];
+static int nglyphs = 0;
+
+// bit offsets of the (8 bit) red, green and blue channels of a pixel.
+static int shifts[3];
+static int completion_type = -1;
+
+// Completions are only ever read by the main loop (Xlib isn't thread safe, see
+// 'raster_complete'), the drawing threads wait for it to signal them.
+static pthread_mutex_t completion_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t completion_cond   = PTHREAD_COND_INITIALIZER;
+
+// a frame that's never completed (e.g. the window is gone) isn't waited on
+// for longer than this (in ms).
+#define MAX_COMPLETION_WAIT 250
+
+#define channel(pixel, i) ((pixel) >> shifts[i] & 0xff)
+
+// 'alpha' (0-255) of 'src' over 'dst', both being (opaque) pixels.
+static inline uint32_t blend(uint32_t dst, uint32_t src, unsigned alpha)
+{
+    uint32_t out = dst;
+    for (int i = 0; i < 3; ++i) {
+        unsigned c = (channel(src, i) * alpha +
+                      channel(dst, i) * (255 - alpha) + 127) /
+                     255;
+        out = (out & ~(0xffu << shifts[i])) | c << shifts[i];
+    }
+    return out;
+}
+
+// premultiplied ARGB32 (see 'clubar/image.h') over a pixel.
+static inline uint32_t over(uint32_t dst, uint32_t argb)
+{
+    unsigned alpha = argb >> 24;
+    uint32_t out   = dst;
+    for (int i = 0; i < 3; ++i) {
+        unsigned c = (argb >> (16 - 8 * i) & 0xff) +
+                     (channel(dst, i) * (255 - alpha) + 127) / 255;
+        out = (out & ~(0xffu << shifts[i])) | (c > 255 ? 255 : c) << shifts[i];
+    }
+    return out;
+}
+
+#define pixels(r, y)                                                           \
+    ((uint32_t *)((r)->image->data + (y) * (r)->image->bytes_per_line))
+
+static inline bool is_completion(const XEvent *e, const Raster *r)
+{
+    return e->type == completion_type &&
+           ((const XShmCompletionEvent *)e)->shmseg == r->shm.shmseg;
+}
+
+// The image isn't drawn on, until the server is done reading the last frame
+// from it. The completion is usually already there (frames are far apart).
+static inline void raster_wait(Raster *r)
+{
+    struct timespec ts;
+    if (!__atomic_load_n(&r->pending, __ATOMIC_ACQUIRE))
+        return;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += MAX_COMPLETION_WAIT * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L, ts.tv_nsec %= 1000000000L;
+    pthread_mutex_lock(&completion_mutex);
+    while (__atomic_load_n(&r->pending, __ATOMIC_ACQUIRE))
+        if (pthread_cond_timedwait(&completion_cond, &completion_mutex, &ts))
+            __atomic_store_n(&r->pending, false, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&completion_mutex);
+}
+
+// clips the rectangle to the image, and adds what's left to the damaged area.
+static inline bool damage(Raster *r, int *x, int *y, int *w, int *h)
+{
+    raster_wait(r);
+    int x0 = *x < 0 ? 0 : *x, y0 = *y < 0 ? 0 : *y;
+    int x1 = *x + *w > r->image->width ? r->image->width : *x + *w;
+    int y1 = *y + *h > r->image->height ? r->image->height : *y + *h;
+    if (x0 >= x1 || y0 >= y1)
+        return false;
+    *x = x0, *y = y0, *w = x1 - x0, *h = y1 - y0;
+    if (r->x0 >= r->x1) {
+        r->x0 = x0, r->y0 = y0, r->x1 = x1, r->y1 = y1;
+    } else {
+        r->x0 = x0 < r->x0 ? x0 : r->x0, r->y0 = y0 < r->y0 ? y0 : r->y0;
+        r->x1 = x1 > r->x1 ? x1 : r->x1, r->y1 = y1 > r->y1 ? y1 : r->y1;
+    }
+    return true;
+}
+
+static inline CachedGlyph *glyph_render(XftFont *font, FT_UInt index)
+{
+    XGlyphInfo info;
+    FT_Face face;
+    CachedGlyph *glyph = (CachedGlyph *)calloc(1, sizeof(CachedGlyph));
+    glyph->font = font, glyph->index = index;
+    // advances as measured by Xft, so that the layout (from 'gui.c') holds.
+    XftGlyphExtents(dpy(), font, &index, 1, &info);
+    glyph->advance = info.xOff;
+
+    if (!(face = XftLockFace(font)))
+        return glyph;
+    if (FT_Load_Glyph(face, index, FT_LOAD_RENDER) == 0) {
+        const FT_Bitmap *bitmap = &face->glyph->bitmap;
+        glyph->left     = face->glyph->bitmap_left;
+        glyph->top      = face->glyph->bitmap_top;
+        glyph->width    = bitmap->width;
+        glyph->height   = bitmap->rows;
+        glyph->coverage = (uint8_t *)malloc(glyph->width * glyph->height + 1);
+        for (int y = 0; y < glyph->height; ++y) {
+            const uint8_t *row = bitmap->buffer + y * bitmap->pitch;
+            for (int x = 0; x < glyph->width; ++x)
+                glyph->coverage[y * glyph->width + x] =
+                    bitmap->pixel_mode == FT_PIXEL_MODE_MONO
+                        ? (row[x >> 3] & (0x80 >> (x & 7)) ? 255 : 0)
+                    : bitmap->pixel_mode == FT_PIXEL_MODE_GRAY ? row[x]
+                                                               : 0;
+        }
+    }
+    XftUnlockFace(font);
+    return glyph;
+}
+
+static inline const CachedGlyph *glyph_get(XftFont *font, FT_UInt index)
+{
+    size_t bucket =
+        ((uintptr_t)font >> 4 ^ index * 2654435761u) & (GLYPH_BUCKETS - 1);
+    for (CachedGlyph *glyph = glyphs[bucket]; glyph; glyph = glyph->next)
+        if (glyph->font == font && glyph->index == index)
+            return glyph;
+    if (nglyphs == MAX_GLYPHS)
+        raster_flush_glyphs();
+    CachedGlyph *glyph = glyph_render(font, index);
+    glyph->next        = glyphs[bucket];
+    glyphs[bucket]     = glyph;
+    nglyphs++;
+    return glyph;
+}
+
+// serial of the pending 'XShmAttach' (0 if none), and whether it failed.
+static unsigned long attach_serial = 0;
+static bool attach_failed          = false;
+
+// To be called by the error handler, returns whether the error is about the
+// attach request of 'raster_create' (i.e. is handled).
+bool raster_on_error(const XErrorEvent *e)
+{
+    if (!attach_serial || e->serial != attach_serial)
+        return false;
+    attach_failed = true;
+    return true;
+}
+
+// The extension might be there, and still not be usable (e.g. remote display),
+// that's only known once a segment is attached (see 'raster_create').
+bool raster_init(void)
+{
+    const Visual *visual   = vis();
+    unsigned long masks[3] = {visual->red_mask, visual->green_mask,
+                              visual->blue_mask};
+    int native = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? LSBFirst
+                                                           : MSBFirst;
+    if (!XShmQueryExtension(dpy()) || visual->class != TrueColor ||
+        ImageByteOrder(dpy()) != native)
+        return false;
+    completion_type = XShmGetEventBase(dpy()) + ShmCompletion;
+    for (int i = 0; i < 3; ++i) {
+        if (!masks[i])
+            return false;
+        shifts[i] = __builtin_ctzl(masks[i]);
+        if (masks[i] >> shifts[i] != 0xff)
+            return false;
+    }
+    return true;
+}
+
+bool raster_create(Raster *r, int width, int height)
+{
+    *r       = (Raster){0};
+    r->image = XShmCreateImage(dpy(), vis(), DefaultDepth(dpy(), scr()),
+                               ZPixmap, NULL, &r->shm, width, height);
+    if (!r->image)
+        return false;
+    if (r->image->bits_per_pixel != 32 ||
+        (r->shm.shmid = shmget(IPC_PRIVATE,
+                               r->image->bytes_per_line * r->image->height,
+                               IPC_CREAT | 0600)) < 0) {
+        XDestroyImage(r->image);
+        return (*r = (Raster){0}), false;
+    }
+    r->shm.shmaddr = r->image->data = shmat(r->shm.shmid, NULL, 0);
+    r->shm.readOnly = False;
+
+    // only the errors of this very request are taken as a failed attach.
+    attach_failed = r->shm.shmaddr == (char *)-1;
+    if (!attach_failed) {
+        attach_serial = NextRequest(dpy());
+        attach_failed = !XShmAttach(dpy(), &r->shm);
+        XSync(dpy(), False);
+        attach_serial = 0;
+    }
+    // the segment goes away with the last detach (i.e. even on a crash).
+    shmctl(r->shm.shmid, IPC_RMID, NULL);
+
+    if (attach_failed) {
+        if (r->shm.shmaddr != (char *)-1)
+            shmdt(r->shm.shmaddr);
+        r->image->data = NULL;
+        XDestroyImage(r->image);
+        return (*r = (Raster){0}), false;
+    }
+    r->gc = XCreateGC(dpy(), root(), 0, NULL);
+    XSetGraphicsExposures(dpy(), r->gc, False);
+    return true;
+}
+
+void raster_destroy(Raster *r)
+{
+    if (!r->image)
+        return;
+    XShmDetach(dpy(), &r->shm);
+    XSync(dpy(), False);
+    shmdt(r->shm.shmaddr);
+    r->image->data = NULL; // not malloc'd, 'XDestroyImage' would free it.
+    XDestroyImage(r->image);
+    XFreeGC(dpy(), r->gc);
+    *r = (Raster){0};
+}
+
+// e.g. on expose, the image is already up to date.
+void raster_damage_all(Raster *r)
+{
+    int x = 0, y = 0, w = r->image->width, h = r->image->height;
+    damage(r, &x, &y, &w, &h);
+}
+
+void raster_fill(Raster *r, const XftColor *color, int x, int y, int w, int h)
+{
+    if (!damage(r, &x, &y, &w, &h))
+        return;
+    for (int j = y; j < y + h; ++j) {
+        uint32_t *row = pixels(r, j);
+        for (int i = x; i < x + w; ++i)
+            row[i] = color->pixel;
+    }
+}
+
+// 'y' is the baseline (as with 'XftDrawStringUtf8').
+void raster_string(Raster *r, XftFont *font, const XftColor *color, int x,
+                   int y, const char *text, int len)
+{
+    FcChar32 ucs4;
+    for (int n; len > 0 && (n = FcUtf8ToUcs4((const FcChar8 *)text, &ucs4,
+                                             len)) > 0;
+         text += n, len -= n) {
+        const CachedGlyph *glyph =
+            glyph_get(font, XftCharIndex(dpy(), font, ucs4));
+        int ox = x + glyph->left, oy = y - glyph->top;
+        int gx = ox, gy = oy, gw = glyph->width, gh = glyph->height;
+        x += glyph->advance;
+        if (!glyph->coverage || !damage(r, &gx, &gy, &gw, &gh))
+            continue;
+        // offsets into the glyph, of the (clipped) rectangle.
+        ox = gx - ox, oy = gy - oy;
+        for (int j = 0; j < gh; ++j) {
+            uint32_t *row      = pixels(r, gy + j) + gx;
+            const uint8_t *cov = glyph->coverage + (oy + j) * glyph->width + ox;
+            for (int i = 0; i < gw; ++i)
+                if (cov[i])
+                    row[i] = cov[i] == 255 ? color->pixel
+                                           : blend(row[i], color->pixel,
+                                                   cov[i]);
+        }
+    }
+}
+
+// 'w' by 'h' pixels of 'src' (from 'sx', 'sy'), over the image at 'x', 'y'.
+void raster_composite(Raster *r, const uint32_t *src, int stride, int sx,
+                      int sy, int x, int y, int w, int h)
+{
+    int cx = x, cy = y;
+    if (!damage(r, &cx, &cy, &w, &h))
+        return;
+    sx += cx - x, sy += cy - y;
+    for (int j = 0; j < h; ++j) {
+        uint32_t *row      = pixels(r, cy + j) + cx;
+        const uint32_t *in = src + (size_t)(sy + j) * stride + sx;
+        for (int i = 0; i < w; ++i)
+            if (in[i] >> 24)
+                row[i] = over(row[i], in[i]);
+    }
+}
+
+void raster_present(Raster *r, Drawable drawable)
+{
+    if (!r->image || r->x0 >= r->x1)
+        return;
+    // completed asynchronously (no round trip), see 'raster_wait'.
+    XShmPutImage(dpy(), drawable, r->gc, r->image, r->x0, r->y0, r->x0, r->y0,
+                 r->x1 - r->x0, r->y1 - r->y0, True);
+    __atomic_store_n(&r->pending, true, __ATOMIC_RELEASE);
+    XFlush(dpy());
+    r->x0 = r->y0 = r->x1 = r->y1 = 0;
+}
+
+// For the events read by the main loop, returns whether the event is the
+// completion of a frame presented from 'r'.
+bool raster_complete(Raster *r, const XEvent *e)
+{
+    if (!r->image || !is_completion(e, r))
+        return false;
+    pthread_mutex_lock(&completion_mutex);
+    __atomic_store_n(&r->pending, false, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&completion_cond);
+    pthread_mutex_unlock(&completion_mutex);
+    return true;
+}
+
+// glyphs are keyed by the font, i.e. have to go when the fonts are closed.
+void raster_flush_glyphs(void)
+{
+    for (int i = 0; i < GLYPH_BUCKETS; ++i)
+        while (glyphs[i]) {
+            CachedGlyph *next = glyphs[i]->next;
+            free(glyphs[i]->coverage);
+            free(glyphs[i]);
+            glyphs[i] = next;
+        }
+    nglyphs = 0;
+}
@@ -0,0 +1,39 @@
+/* MIT-SHM software rasterizer ('--shm'), for remote (e.g. VNC) sessions where
+ * XRender is slow or emulated, and every 'XftDraw*' request adds up. A frame
+ * is drawn on the client, into a shared memory XImage (glyphs are rendered
+ * with FreeType once, and cached), and presented with a single
+ * 'XShmPutImage', limited to the area that was drawn on (damaged). Presenting
+ * doesn't wait for the server, the next frame does (on 'ShmCompletion').
+ */
+#ifndef __WITH_X11__RASTER_H__
+#define __WITH_X11__RASTER_H__
+
+#include <X11/Xft/Xft.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Raster {
+    XImage *image; // NULL, if not created.
+    XShmSegmentInfo shm;
+    GC gc;
+    int x0, y0, x1, y1; // damaged area (empty, if 'x0 >= x1').
+    bool pending;       // the last frame is still being read by the server.
+} Raster;
+
+bool raster_init(void);
+bool raster_create(Raster *, int, int);
+void raster_destroy(Raster *);
+void raster_damage_all(Raster *);
+void raster_fill(Raster *, const XftColor *, int, int, int, int);
+void raster_string(Raster *, XftFont *, const XftColor *, int, int,
+                   const char *, int);
+void raster_composite(Raster *, const uint32_t *, int, int, int, int, int, int,
+                      int);
+void raster_present(Raster *, Drawable);
+bool raster_complete(Raster *, const XEvent *);
+bool raster_on_error(const XErrorEvent *);
+void raster_flush_glyphs(void);
+
+#endif
@@ -0,0 +1,83 @@
+/* Regression test: once warmed up, parsing lines into blocks doesn't allocate.
+ *
+ * A recorded session (see 'clubar/replay.h') is replayed through
+ * 'clubar_update_blks' a few times, as fast as possible, so that the caches
+ * (e.g. the tag stash) grow to what the session needs at most. The pass after
+ * that fails on any allocation, as 'malloc' & co are interposed here.
+ *   make test
+ *
+ * Only parsing is covered, drawing (e.g. the color cache) and actions
+ * ('posix_spawnp') need an X server, and aren't run here.
+ */
+#include <clubar.h>
+#include <clubar/replay.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void __libc_free(void *);
+
+#define WARMUP_PASSES 3
+
+static bool counting = false;
+static unsigned long allocations = 0;
+
+void *malloc(size_t size)
+{
+    allocations += counting;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    allocations += counting;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations += counting;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+
+// returns the number of replayed events.
+static inline int replay(CluBar *clubar, Replay *replay)
+{
+    char channel[32], line[BLK_BUFFER_SIZE];
+    int nevents = 0;
+    rewind(replay->fp);
+    for (BlockType blktype; replay_next(replay, channel, line, sizeof(line));
+         ++nevents)
+        if ((blktype = clubar_channel(clubar, channel)) >= 0)
+            clubar_update_blks(clubar, blktype, line);
+    return nevents;
+}
+
+int main(int argc, const char **argv)
+{
+    CluBar clubar = {0};
+    Replay session;
+    if (argc != 2) {
+        eprintf("USAGE: %s session.rec\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    clubar_init(&clubar);
+    clubar_load_external_configs(&clubar);
+    if (!replay_open(&session, argv[1], 0))
+        die("Unable to open replay file: '%s'.\n", argv[1]);
+
+    for (int i = 0; i < WARMUP_PASSES; ++i)
+        replay(&clubar, &session);
+    counting   = true;
+    int events = replay(&clubar, &session);
+    counting   = false;
+
+    replay_close(&session);
+    clubar_destroy(&clubar);
+    printf("%s: %d events, %lu allocations.\n", argv[1], events, allocations);
+    return allocations == 0 && events > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}